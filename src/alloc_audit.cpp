@@ -0,0 +1,135 @@
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif // _WIN32
+
+#include "./alloc_audit.hpp"
+
+static thread_local bool s_counting = false;
+static thread_local uint64_t s_count = 0;
+
+bool AllocAudit::enabled()
+{
+#ifdef CHESS_ALLOC_AUDIT
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocAudit::begin()
+{
+    s_count = 0;
+    s_counting = true;
+}
+
+uint64_t AllocAudit::end()
+{
+    s_counting = false;
+    return s_count;
+}
+
+#ifdef CHESS_ALLOC_AUDIT
+
+static void* counted_malloc(std::size_t size) noexcept
+{
+    if (s_counting) {
+        ++s_count;
+    }
+    return std::malloc(size != 0 ? size : 1);
+}
+
+/**
+ * over-aligned types (Board is alignas(64)) go through the align_val_t
+ * overloads, which must be counted and freed by their own pair
+ */
+static void* counted_malloc(std::size_t size, std::align_val_t align) noexcept
+{
+    if (s_counting) {
+        ++s_count;
+    }
+    size = size != 0 ? size : 1;
+#ifdef _WIN32
+    return _aligned_malloc(size, static_cast<std::size_t>(align));
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, static_cast<std::size_t>(align), size) != 0) {
+        return nullptr;
+    }
+    return p;
+#endif // _WIN32
+}
+
+static void aligned_free(void* p) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif // _WIN32
+}
+
+void* operator new(std::size_t size)
+{
+    void* p = counted_malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    void* p = counted_malloc(size, align);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return operator new(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return counted_malloc(size, align);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+
+#endif // CHESS_ALLOC_AUDIT
@@ -0,0 +1,19 @@
+#ifndef CHESS_ALLOC_AUDIT_H
+#define CHESS_ALLOC_AUDIT_H
+
+#include <cstdint>
+
+/**
+ * counts heap allocations made by the current thread between begin() and end().
+ * global operator new is only hooked when built with CHESS_ALLOC_AUDIT,
+ * otherwise end() always returns 0
+ */
+struct AllocAudit
+{
+    static bool enabled();
+    static void begin();
+    /* stop counting, return number of allocations since begin() */
+    static uint64_t end();
+};
+
+#endif // CHESS_ALLOC_AUDIT_H
@@ -0,0 +1,44 @@
+#include "./attack_info.hpp"
+#include "./attacks.hpp"
+#include "./board.hpp"
+
+/**
+ * pawns are handled as a whole set, other pieces one by one with queens
+ * folded into the bishop and rook sweeps
+ */
+static void compute_color_attacks(const Board& b, Color clr, AttackInfo& ai)
+{
+    const Bitboard occupied = b.get_occupied();
+
+    const Bitboard pawns = b.get_pieces(clr, P_PAWN);
+    Bitboard attacks = clr == C_WHITE
+        ? ((pawns & ~FILE_A_BB) << 7) | ((pawns & ~FILE_H_BB) << 9)
+        : ((pawns & ~FILE_A_BB) >> 9) | ((pawns & ~FILE_H_BB) >> 7);
+
+    Bitboard pieces = b.get_pieces(clr, P_KNIGHT);
+    while (pieces) {
+        attacks |= knight_attacks(pop_lsb(pieces));
+    }
+
+    pieces = b.get_pieces(clr, P_BISHOP) | b.get_pieces(clr, P_QUEEN);
+    while (pieces) {
+        attacks |= bishop_attacks(pop_lsb(pieces), occupied);
+    }
+
+    pieces = b.get_pieces(clr, P_ROOK) | b.get_pieces(clr, P_QUEEN);
+    while (pieces) {
+        attacks |= rook_attacks(pop_lsb(pieces), occupied);
+    }
+
+    attacks |= king_attacks(b.get_king_pos(clr).to_val());
+
+    ai.by_color[clr] = attacks;
+}
+
+void AttackInfo::compute(const Board& b)
+{
+    compute_color_attacks(b, C_WHITE, *this);
+    compute_color_attacks(b, C_BLACK, *this);
+    pinned = b.pinned_pieces(b.get_next_move());
+    checkers = b.checkers();
+}
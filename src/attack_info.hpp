@@ -0,0 +1,37 @@
+#ifndef CHESS_ATTACK_INFO_H
+#define CHESS_ATTACK_INFO_H
+
+#include <cstdint>
+
+#include "./types.hpp"
+#include "./bitboard.hpp"
+
+class Board;
+
+/**
+ * attack maps of one position, computed at most once per search node
+ * and read by castling, legal move filtering (pins and checkers),
+ * SAN disambiguation and the recapture test of move ordering instead of
+ * each of them scanning for attacks again
+ */
+struct AttackInfo
+{
+    Bitboard by_color[2];              // squares attacked by any piece of a color
+    Bitboard pinned;                   // pieces of the side to move pinned to their king
+    Bitboard checkers;                 // pieces giving check to the side to move
+
+    AttackInfo() = default;
+    explicit AttackInfo(const Board& b) { compute(b); }
+
+    void compute(const Board& b);
+
+    bool is_attacked(uint8_t sq, Color by_clr) const {
+        return (by_color[by_clr] & square_bb(sq)) != 0;
+    }
+    bool is_any_attacked(Bitboard squares, Color by_clr) const {
+        return (by_color[by_clr] & squares) != 0;
+    }
+    bool in_check() const { return checkers != 0; }
+};
+
+#endif // CHESS_ATTACK_INFO_H
@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <array>
+
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "./attacks.hpp"
+#include "./types.hpp"
+
+Magic AttackTables::bishop_magics[64];
+Magic AttackTables::rook_magics[64];
+
+CpuFeatures AttackTables::cpu;
+SliderBackend AttackTables::backend = SliderBackend::PORTABLE;
+
+// sum over all squares of 2^(number of relevant occupancy bits)
+static Bitboard rook_table[0x19000];
+static Bitboard bishop_table[0x1480];
+
+static constexpr Vec rook_vectors[4] = { {-1, 0}, {+1, 0}, {0, -1}, {0, +1} };
+static constexpr Vec bishop_vectors[4] = { {-1, -1}, {-1, +1}, {+1, -1}, {+1, +1} };
+// first 4 directions go toward increasing square index
+static constexpr Vec ray_vectors[8] = {
+    {+1, 0}, {0, +1}, {+1, +1}, {+1, -1},
+    {-1, 0}, {0, -1}, {-1, -1}, {-1, +1},
+};
+static constexpr Vec knight_vectors[8] = {
+    {-1, -2}, {-1, +2}, {-2, +1}, {-2, -1},
+    {+1, -2}, {+1, +2}, {+2, +1}, {+2, -1},
+};
+static constexpr Vec king_vectors[8] = {
+    {-1, 0}, {+1, 0}, {0, +1}, {0, -1},
+    {-1, -1}, {-1, +1}, {+1, -1}, {+1, +1},
+};
+
+// found once by a search over sparse random numbers (xorshift64*,
+// one seed per row), indices of all occupancies collide constructively
+static constexpr Bitboard bishop_magic_numbers[64] = {
+    0x40106000A1160020_u64, 0x0020010250810120_u64, 0x2010010220280081_u64, 0x002806004050C040_u64,
+    0x0002021018000000_u64, 0x2001112010000400_u64, 0x0881010120218080_u64, 0x1030820110010500_u64,
+    0x0000120222042400_u64, 0x2000020404040044_u64, 0x8000480094208000_u64, 0x0003422A02000001_u64,
+    0x000A220210100040_u64, 0x8004820202226000_u64, 0x0018234854100800_u64, 0x0100004042101040_u64,
+    0x0004001004082820_u64, 0x0010000810010048_u64, 0x1014004208081300_u64, 0x2080818802044202_u64,
+    0x0040880C00A00100_u64, 0x0080400200522010_u64, 0x0001000188180B04_u64, 0x0080249202020204_u64,
+    0x1004400004100410_u64, 0x00013100A0022206_u64, 0x2148500001040080_u64, 0x4241080011004300_u64,
+    0x4020848004002000_u64, 0x10101380D1004100_u64, 0x0008004422020284_u64, 0x01010A1041008080_u64,
+    0x0808080400082121_u64, 0x0808080400082121_u64, 0x0091128200100C00_u64, 0x0202200802010104_u64,
+    0x8C0A020200440085_u64, 0x01A0008080B10040_u64, 0x0889520080122800_u64, 0x100902022202010A_u64,
+    0x04081A0816002000_u64, 0x0000681208005000_u64, 0x8170840041008802_u64, 0x0A00004200810805_u64,
+    0x0830404408210100_u64, 0x2602208106006102_u64, 0x1048300680802628_u64, 0x2602208106006102_u64,
+    0x0602010120110040_u64, 0x0941010801043000_u64, 0x000040440A210428_u64, 0x0008240020880021_u64,
+    0x0400002012048200_u64, 0x00AC102001210220_u64, 0x0220021002009900_u64, 0x84440C080A013080_u64,
+    0x0001008044200440_u64, 0x0004C04410841000_u64, 0x2000500104011130_u64, 0x1A0C010011C20229_u64,
+    0x0044800112202200_u64, 0x0434804908100424_u64, 0x0300404822C08200_u64, 0x48081010008A2A80_u64
+};
+static constexpr Bitboard rook_magic_numbers[64] = {
+    0x0A80004000801220_u64, 0x8040004010002008_u64, 0x2080200010008008_u64, 0x1100100008210004_u64,
+    0xC200209084020008_u64, 0x2100010004000208_u64, 0x0400081000822421_u64, 0x0200010422048844_u64,
+    0x0800800080400024_u64, 0x0001402000401000_u64, 0x3000801000802001_u64, 0x4400800800100083_u64,
+    0x0904802402480080_u64, 0x4040800400020080_u64, 0x0018808042000100_u64, 0x4040800080004100_u64,
+    0x0040048001458024_u64, 0x00A0004000205000_u64, 0x3100808010002000_u64, 0x4825010010000820_u64,
+    0x5004808008000401_u64, 0x2024818004000A00_u64, 0x0005808002000100_u64, 0x2100060004806104_u64,
+    0x0080400880008421_u64, 0x4062220600410280_u64, 0x010A004A00108022_u64, 0x0000100080080080_u64,
+    0x0021000500080010_u64, 0x0044000202001008_u64, 0x0000100400080102_u64, 0xC020128200040545_u64,
+    0x0080002000400040_u64, 0x0000804000802004_u64, 0x0000120022004080_u64, 0x010A386103001001_u64,
+    0x9010080080800400_u64, 0x8440020080800400_u64, 0x0004228824001001_u64, 0x000000490A000084_u64,
+    0x0080002000504000_u64, 0x200020005000C000_u64, 0x0012088020420010_u64, 0x0010010080080800_u64,
+    0x0085001008010004_u64, 0x0002000204008080_u64, 0x0040413002040008_u64, 0x0000304081020004_u64,
+    0x0080204000800080_u64, 0x3008804000290100_u64, 0x1010100080200080_u64, 0x2008100208028080_u64,
+    0x5000850800910100_u64, 0x8402019004680200_u64, 0x0120911028020400_u64, 0x0000008044010200_u64,
+    0x0020850200244012_u64, 0x0020850200244012_u64, 0x0000102001040841_u64, 0x140900040A100021_u64,
+    0x000200282410A102_u64, 0x000200282410A102_u64, 0x000200282410A102_u64, 0x4048240043802106_u64
+};
+
+/**
+ * square reached from sq by stepping `v` once, or -1 if off the board
+ */
+static constexpr int step(uint8_t sq, const Vec& v)
+{
+    int row = (sq >> 3) + v.row;
+    int column = (sq & 7) + v.column;
+    if (row < 0 || row > 7 || column < 0 || column > 7) {
+        return -1;
+    }
+    return row * 8 + column;
+}
+
+/**
+ * reference (slow) slider attack: walk every ray until a blocker is met
+ */
+static constexpr Bitboard sliding_attacks(const Vec (&vectors)[4], uint8_t sq, Bitboard occupied)
+{
+    Bitboard attacks = 0;
+    for (const auto& v : vectors) {
+        int s = sq;
+        while ((s = step(s, v)) >= 0) {
+            attacks |= square_bb(s);
+            if (occupied & square_bb(s)) {
+                break;
+            }
+        }
+    }
+    return attacks;
+}
+
+/* squares one step away along each of `vectors` */
+static constexpr SquareTable step_attacks_table(const Vec (&vectors)[8])
+{
+    SquareTable table{};
+    for (uint8_t sq = 0; sq < 64; ++sq) {
+        for (const auto& v : vectors) {
+            int s = step(sq, v);
+            if (s >= 0) { table[sq] |= square_bb(s); }
+        }
+    }
+    return table;
+}
+
+static constexpr std::array<SquareTable, 2> pawn_attacks_table()
+{
+    std::array<SquareTable, 2> table{};
+    for (uint8_t c = C_BLACK; c <= C_WHITE; ++c) {
+        int8_t offset = c == C_WHITE ? +1 : -1;
+        for (uint8_t sq = 0; sq < 64; ++sq) {
+            for (int8_t dc : { -1, +1 }) {
+                int s = step(sq, Vec{ offset, dc });
+                if (s >= 0) { table[c][sq] |= square_bb(s); }
+            }
+        }
+    }
+    return table;
+}
+
+static constexpr std::array<SquareTable, 8> rays_table()
+{
+    std::array<SquareTable, 8> table{};
+    for (int dir = 0; dir < 8; ++dir) {
+        for (uint8_t sq = 0; sq < 64; ++sq) {
+            int s = sq;
+            while ((s = step(s, ray_vectors[dir])) >= 0) {
+                table[dir][sq] |= square_bb(s);
+            }
+        }
+    }
+    return table;
+}
+
+/* between (`whole_line` false) or line (true) masks of aligned squares */
+static constexpr std::array<SquareTable, 64> aligned_table(bool whole_line)
+{
+    constexpr auto rays = rays_table();
+    std::array<SquareTable, 64> table{};
+    for (uint8_t sq = 0; sq < 64; ++sq) {
+        for (int dir = 0; dir < 8; ++dir) {
+            // opposite direction is dir +/- 4
+            Bitboard full = rays[dir][sq] | rays[dir ^ 4][sq] | square_bb(sq);
+            Bitboard ray = rays[dir][sq];
+            while (ray) {
+                uint8_t other = pop_lsb(ray);
+                table[sq][other] = whole_line ? full
+                    : rays[dir][sq] & ~rays[dir][other] & ~square_bb(other);
+            }
+        }
+    }
+    return table;
+}
+
+constinit const SquareTable AttackTables::knight = step_attacks_table(knight_vectors);
+constinit const SquareTable AttackTables::king = step_attacks_table(king_vectors);
+constinit const std::array<SquareTable, 2> AttackTables::pawn = pawn_attacks_table();
+constinit const std::array<SquareTable, 8> AttackTables::rays = rays_table();
+constinit const std::array<SquareTable, 64> AttackTables::between = aligned_table(false);
+constinit const std::array<SquareTable, 64> AttackTables::line = aligned_table(true);
+
+/**
+ * ray attack in direction `dir` stopped at first blocker
+ */
+static inline Bitboard ray_attacks(int dir, uint8_t sq, Bitboard occupied)
+{
+    Bitboard ray = AttackTables::rays[dir][sq];
+    Bitboard blockers = ray & occupied;
+    if (blockers) {
+        uint8_t first = dir < 4 ? lsb(blockers) : msb(blockers);
+        ray ^= AttackTables::rays[dir][first];
+    }
+    return ray;
+}
+
+Bitboard portable_rook_attacks(uint8_t sq, Bitboard occupied)
+{
+    return ray_attacks(0, sq, occupied) | ray_attacks(1, sq, occupied)
+        | ray_attacks(4, sq, occupied) | ray_attacks(5, sq, occupied);
+}
+
+Bitboard portable_bishop_attacks(uint8_t sq, Bitboard occupied)
+{
+    return ray_attacks(2, sq, occupied) | ray_attacks(3, sq, occupied)
+        | ray_attacks(6, sq, occupied) | ray_attacks(7, sq, occupied);
+}
+
+static void init_magics(
+    const Vec (&vectors)[4], const Bitboard (&magic_numbers)[64],
+    Bitboard* table, Magic (&magics)[64], SliderBackend backend)
+{
+    size_t offset = 0;
+    for (uint8_t sq = 0; sq < 64; ++sq) {
+        Magic& m = magics[sq];
+
+        // board edges are not relevant unless the slider stands on them
+        Bitboard edges = ((RANK_1_BB | RANK_8_BB) & ~rank_bb(sq >> 3))
+            | ((FILE_A_BB | FILE_H_BB) & ~file_bb(sq & 7));
+        m.mask = sliding_attacks(vectors, sq, 0) & ~edges;
+        m.shift = (uint8_t)(64 - popcount(m.mask));
+        m.magic = backend == SliderBackend::PEXT ? 0 : magic_numbers[sq];
+        m.attacks = table + offset;
+        size_t size = size_t(1) << popcount(m.mask);
+        offset += size;
+        // may be refilled when the backend changes
+        std::fill(m.attacks, m.attacks + size, 0);
+
+        // enumerate all subsets of the mask (carry-rippler trick)
+        Bitboard b = 0;
+        do {
+            uint32_t idx = m.index(b);
+#ifdef CHESS_HAS_PEXT
+            if (backend == SliderBackend::PEXT) {
+                // pext gives a perfect index, no magic needed
+                idx = (uint32_t)pext(b, m.mask);
+            }
+#endif
+            Bitboard attacks = sliding_attacks(vectors, sq, b);
+#ifdef CHESS_DEBUG
+            // slider attacks are never empty, a set slot is a collision
+            if (m.attacks[idx] != 0 && m.attacks[idx] != attacks) {
+                throw chess_exception("destructive magic collision");
+            }
+#endif
+            m.attacks[idx] = attacks;
+            b = (b - m.mask) & m.mask;
+        } while (b);
+    }
+}
+
+static CpuFeatures detect_cpu_features()
+{
+    CpuFeatures f{ false, false, false, false };
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    f.bmi2 = __builtin_cpu_supports("bmi2");
+    f.popcnt = __builtin_cpu_supports("popcnt");
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.slow_pext = __builtin_cpu_is("amdfam15h")
+        || __builtin_cpu_is("znver1")
+        || __builtin_cpu_is("znver2");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[4];
+    __cpuid(regs, 0);
+    bool is_amd = regs[1] == 0x68747541; // "Auth"enticAMD
+    int max_leaf = regs[0];
+    __cpuid(regs, 1);
+    f.popcnt = (regs[2] >> 23) & 1;
+    int family = ((regs[0] >> 8) & 0xF) + ((regs[0] >> 20) & 0xFF);
+    if (max_leaf >= 7) {
+        __cpuidex(regs, 7, 0);
+        f.bmi2 = (regs[1] >> 8) & 1;
+        f.avx2 = (regs[1] >> 5) & 1;
+    }
+    f.slow_pext = is_amd && family < 0x19;
+#endif
+    return f;
+}
+
+static SliderBackend choose_slider_backend(const CpuFeatures& cpu)
+{
+#ifdef CHESS_HAS_PEXT
+    if (cpu.bmi2 && !cpu.slow_pext) {
+        return SliderBackend::PEXT;
+    }
+#endif
+    if (sizeof(void*) >= 8) {
+        return SliderBackend::MAGIC;
+    }
+    // 64-bit multiply is expensive on 32-bit targets
+    return SliderBackend::PORTABLE;
+}
+
+void AttackTables::init_slider_tables(SliderBackend b)
+{
+    backend = b;
+    if (backend == SliderBackend::PORTABLE) {
+        return; // only needs the rays
+    }
+    init_magics(bishop_vectors, bishop_magic_numbers, bishop_table, bishop_magics, backend);
+    init_magics(rook_vectors, rook_magic_numbers, rook_table, rook_magics, backend);
+}
+
+void AttackTables::init_tables()
+{
+    // knight, king, pawn, rays, between and line tables are constant data
+    cpu = detect_cpu_features();
+    init_slider_tables(choose_slider_backend(cpu));
+}
+
+std::string slider_backend_description()
+{
+    const char* name = "portable";
+    if (AttackTables::backend == SliderBackend::PEXT) {
+        name = "pext";
+    }
+    else if (AttackTables::backend == SliderBackend::MAGIC) {
+        name = "magic";
+    }
+    const auto& cpu = AttackTables::cpu;
+    return fmt::format(
+        "{} (cpu: bmi2={} popcnt={} avx2={}{})",
+        name, cpu.bmi2, cpu.popcnt, cpu.avx2,
+        cpu.slow_pext ? " slow_pext" : ""
+    );
+}
@@ -0,0 +1,140 @@
+#ifndef CHESS_ATTACKS_H
+#define CHESS_ATTACKS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "./types.hpp"
+#include "./bitboard.hpp"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#   include <immintrin.h>
+#   define CHESS_HAS_PEXT 1
+inline uint64_t pext(uint64_t value, uint64_t mask) { return _pext_u64(value, mask); }
+#elif defined(__GNUC__) && defined(__x86_64__)
+#   define CHESS_HAS_PEXT 1
+// inline asm so it can be inlined without compiling the whole binary for BMI2,
+// only ever executed when the cpu reported BMI2 support at startup
+inline uint64_t pext(uint64_t value, uint64_t mask)
+{
+    uint64_t res;
+    __asm__("pextq %2, %1, %0" : "=r"(res) : "r"(value), "rm"(mask));
+    return res;
+}
+#endif
+
+/**
+ * how slider attacks are looked up, chosen at startup from cpu features
+ */
+enum class SliderBackend : uint8_t {
+    PORTABLE = 0, // scan rays for first blocker, no big table nor 64-bit multiply
+    MAGIC,        // "fancy" magic multiplication indexing
+    PEXT,         // BMI2 parallel bit extract indexing
+};
+
+struct CpuFeatures {
+    bool bmi2;
+    bool popcnt;
+    bool avx2;
+    bool slow_pext; // microcoded pext (AMD before zen3)
+};
+
+/**
+ * magic bitboard entry for one square of a slider:
+ * the relevant occupancy (`mask`) is hashed by a multiplication
+ * with `magic` (or by pext) into an index in this square's slice
+ * of the attack table
+ */
+struct Magic {
+    Bitboard mask;
+    Bitboard magic;
+    Bitboard* attacks;
+    uint8_t shift;
+
+    inline uint32_t index(Bitboard occupied) const {
+        return (uint32_t)(((occupied & mask) * magic) >> shift);
+    }
+};
+
+using SquareTable = std::array<Bitboard, 64>;
+
+/**
+ * non-slider tables are generated at compile time into read-only data,
+ * slider tables depend on the backend and are filled by init_tables
+ */
+struct AttackTables
+{
+    static const SquareTable knight;
+    static const SquareTable king;
+    static const std::array<SquareTable, 2> pawn; // squares attacked by a pawn of given color
+    static const std::array<SquareTable, 8> rays; // empty-board ray from square, per direction
+    static const std::array<SquareTable, 64> between; // squares strictly between two aligned squares
+    static const std::array<SquareTable, 64> line; // whole line through two aligned squares
+
+    static Magic bishop_magics[64];
+    static Magic rook_magics[64];
+
+    static CpuFeatures cpu;
+    static SliderBackend backend;
+
+    static void init_tables();
+    static void init_slider_tables(SliderBackend backend);
+};
+
+std::string slider_backend_description();
+
+Bitboard portable_bishop_attacks(uint8_t sq, Bitboard occupied);
+Bitboard portable_rook_attacks(uint8_t sq, Bitboard occupied);
+
+inline Bitboard knight_attacks(uint8_t sq) { return AttackTables::knight[sq]; }
+inline Bitboard king_attacks(uint8_t sq) { return AttackTables::king[sq]; }
+inline Bitboard pawn_attacks(Color clr, uint8_t sq) { return AttackTables::pawn[clr][sq]; }
+/* empty when `a` and `b` are not on a common row, column or diagonal */
+inline Bitboard between_bb(uint8_t a, uint8_t b) { return AttackTables::between[a][b]; }
+inline Bitboard line_bb(uint8_t a, uint8_t b) { return AttackTables::line[a][b]; }
+
+inline Bitboard bishop_attacks(uint8_t sq, Bitboard occupied)
+{
+    const Magic& m = AttackTables::bishop_magics[sq];
+    switch (AttackTables::backend) {
+#ifdef CHESS_HAS_PEXT
+    case SliderBackend::PEXT: return m.attacks[pext(occupied, m.mask)];
+#endif
+    case SliderBackend::MAGIC: return m.attacks[m.index(occupied)];
+    default: return portable_bishop_attacks(sq, occupied);
+    }
+}
+
+inline Bitboard rook_attacks(uint8_t sq, Bitboard occupied)
+{
+    const Magic& m = AttackTables::rook_magics[sq];
+    switch (AttackTables::backend) {
+#ifdef CHESS_HAS_PEXT
+    case SliderBackend::PEXT: return m.attacks[pext(occupied, m.mask)];
+#endif
+    case SliderBackend::MAGIC: return m.attacks[m.index(occupied)];
+    default: return portable_rook_attacks(sq, occupied);
+    }
+}
+
+inline Bitboard queen_attacks(uint8_t sq, Bitboard occupied)
+{
+    return bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
+}
+
+/* squares attacked by piece `p` of color `clr` standing on `sq` */
+inline Bitboard piece_attacks(Piece p, Color clr, uint8_t sq, Bitboard occupied)
+{
+    switch (p) {
+    case P_PAWN: return pawn_attacks(clr, sq);
+    case P_KNIGHT: return knight_attacks(sq);
+    case P_BISHOP: return bishop_attacks(sq, occupied);
+    case P_ROOK: return rook_attacks(sq, occupied);
+    case P_QUEEN: return queen_attacks(sq, occupied);
+    case P_KING: return king_attacks(sq);
+    default: return 0;
+    }
+}
+
+#endif // CHESS_ATTACKS_H
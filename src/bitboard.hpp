@@ -0,0 +1,41 @@
+#ifndef CHESS_BITBOARD_H
+#define CHESS_BITBOARD_H
+
+#include <bit>
+#include <cstdint>
+
+#include "./types.hpp"
+
+/**
+ * one bit per square, bit index is `row * 8 + column` (a1=0, h8=63)
+ */
+using Bitboard = uint64_t;
+
+constexpr Bitboard FILE_A_BB = 0x0101010101010101_u64;
+constexpr Bitboard FILE_H_BB = FILE_A_BB << 7;
+constexpr Bitboard RANK_1_BB = 0xFF_u64;
+constexpr Bitboard RANK_8_BB = RANK_1_BB << (8 * 7);
+
+inline constexpr Bitboard file_bb(uint8_t column) { return FILE_A_BB << column; }
+inline constexpr Bitboard rank_bb(uint8_t row) { return RANK_1_BB << (8 * row); }
+
+inline constexpr Bitboard square_bb(uint8_t sq) { return 1_u64 << sq; }
+inline constexpr Bitboard square_bb(const Pos& pos) { return 1_u64 << pos.to_val(); }
+
+inline constexpr int popcount(Bitboard b) { return std::popcount(b); }
+
+/* index of least significant bit, b must not be empty */
+inline constexpr uint8_t lsb(Bitboard b) { return (uint8_t)std::countr_zero(b); }
+
+/* index of most significant bit, b must not be empty */
+inline constexpr uint8_t msb(Bitboard b) { return (uint8_t)(63 - std::countl_zero(b)); }
+
+/* remove least significant bit from b and return its index */
+inline constexpr uint8_t pop_lsb(Bitboard& b)
+{
+    uint8_t sq = lsb(b);
+    b &= b - 1;
+    return sq;
+}
+
+#endif // CHESS_BITBOARD_H
@@ -1,6 +1,7 @@
 #include <vector>
 #include <iostream>
 
+#include "./attacks.hpp"
 #include "./fen_reader.hpp"
 #include "./move_generation.hpp"
 #include "./board.hpp"
@@ -12,6 +13,8 @@ void Board::load_position(const std::string& fen_position)
     FenReader r;
     r.load_position(*this, fen_position);
     m_key = HashMethods::full_hash(*this);
+    forget_king_checked();
+    m_states.clear();
 }
 
 void load_test_position(Board &b, int position)
@@ -36,32 +39,6 @@ void Board::load_initial_position()
     //load_position("8/7R/2p1k3/p3P2P/1p6/1P1r4/1KP4r/8 b - - 0 1");
 }
 
-Piece Board::get_piece_at(const Pos& pos) const {
-    if (pos.column > 7 || pos.row > 7) {
-        std::abort();
-    }
-    auto x = pos.column + pos.row * 8;
-    uint8_t q = x >> 1;
-    uint8_t n = x & 1;
-    uint8_t val = (m_board[q] >> (4 * n)) & P_PIECE_MASK;
-    return (Piece)val;
-}
-
-Color Board::get_color_at(const Pos& pos) const {
-
-    if (pos.column > 7 || pos.row > 7) {
-        std::abort();
-    }
-    uint8_t x = pos.column + pos.row * 8;
-    uint8_t q = x >> 1;
-    uint8_t n = x & 1;
-    uint8_t val = (m_board[q] >> (4 * n)) & 0x0F;
-    if (val == 0) {
-        return C_EMPTY;
-    }
-    return (Color) (val >> 3);
-}
-
 void Board::set_piece_at(const Pos& pos, Piece p, Color c) {
 #ifdef CHESS_DEBUG
     if (pos.column > 7 || pos.row > 7) {
@@ -74,84 +51,317 @@ void Board::set_piece_at(const Pos& pos, Piece p, Color c) {
         std::abort();
     }
 #endif
-    uint8_t x = pos.column + pos.row * 8;
-    uint8_t q = x >> 1;
-    uint8_t n = x & 1;
-
-    uint8_t store = m_board[q];
-    uint8_t newval = ((uint8_t)p) | (((uint8_t)c)<<3);
-
+    uint8_t x = pos.to_val();
+    Bitboard bb = square_bb(x);
+
+    // remove previous occupant
+    uint8_t old = m_mailbox[x];
+    if (old != 0) {
+        m_pieces[old & P_PIECE_MASK] &= ~bb;
+        m_colors[old >> 3] &= ~bb;
+    }
 
-    m_board[q] = (store & (0x0F << (4 * (1-n))))  | (newval << (4 * n));
+    if (p == P_EMPTY) {
+        m_mailbox[x] = 0;
+        return;
+    }
+    m_mailbox[x] = ((uint8_t)p) | (((uint8_t)c)<<3);
+    m_pieces[p] |= bb;
+    m_colors[c] |= bb;
 
     if (p == P_KING) {
         set_king_pos(pos, c);
     }
 }
 
-bool Board::is_square_attacked(const Pos &pos, Color attacked_by_clr)
+/**
+ * pieces of both colors attacking `sq`, sliders see through nothing
+ * but `occupied` (so callers can remove or add blockers)
+ */
+Bitboard Board::attackers_to(uint8_t sq, Bitboard occupied) const
 {
-    MoveList ml;
-    bool fake_piece = get_piece_at(pos) == P_EMPTY;
-    if (fake_piece) {
-        set_piece_at(pos, P_PAWN, other_color(attacked_by_clr));
-    }
-    find_move_to_position(*this, pos, ml, attacked_by_clr, 1, true);
-    if (fake_piece) {
-        set_piece_at(pos, P_EMPTY, C_BLACK);
-    }
-    return ml.size() == 1;
+    const Bitboard queens = m_pieces[P_QUEEN];
+    return (pawn_attacks(C_WHITE, sq) & get_pieces(C_BLACK, P_PAWN))
+        | (pawn_attacks(C_BLACK, sq) & get_pieces(C_WHITE, P_PAWN))
+        | (knight_attacks(sq) & m_pieces[P_KNIGHT])
+        | (king_attacks(sq) & m_pieces[P_KING])
+        | (bishop_attacks(sq, occupied) & (m_pieces[P_BISHOP] | queens))
+        | (rook_attacks(sq, occupied) & (m_pieces[P_ROOK] | queens));
 }
 
-int8_t Board::compute_king_checked(Color clr)
-{ // start from king position and do 'inversed-move' of all type of piece
-  // to see if we land on a threatening piece
-    Pos p = get_king_pos(clr);
-    MoveList ml;
-    find_move_to_position(*this, p, ml, other_color(clr), 1, true);
-    return ml.size() == 1 ? 1 : 0;
+/**
+ * true if any piece of `attacked_by_clr` attacks `pos`,
+ * checks cheap piece types first to exit early
+ */
+bool Board::is_square_attacked(const Pos &pos, Color attacked_by_clr) const
+{
+    const uint8_t sq = pos.to_val();
+    const Bitboard occupied = get_occupied();
+    const Bitboard queens = get_pieces(attacked_by_clr, P_QUEEN);
+    return (pawn_attacks(other_color(attacked_by_clr), sq) & get_pieces(attacked_by_clr, P_PAWN))
+        || (knight_attacks(sq) & get_pieces(attacked_by_clr, P_KNIGHT))
+        || (king_attacks(sq) & get_pieces(attacked_by_clr, P_KING))
+        || (bishop_attacks(sq, occupied) & (get_pieces(attacked_by_clr, P_BISHOP) | queens))
+        || (rook_attacks(sq, occupied) & (get_pieces(attacked_by_clr, P_ROOK) | queens));
 }
 
-void Board::make_move(const Move& move)
+bool Board::is_any_square_attacked(Bitboard squares, Color attacked_by_clr) const
 {
-    //check_valid_state();
+    while (squares) {
+        if (is_square_attacked(Pos{ pop_lsb(squares) }, attacked_by_clr)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Bitboard Board::checkers() const
+{
+    Color clr = get_next_move();
+    return attackers_to(get_king_pos(clr).to_val(), get_occupied())
+        & m_colors[other_color(clr)];
+}
 
-    #ifdef CHESS_DEBUG
-    if (move.color != get_next_move()) {
-        throw std::exception("invalid move for next_to_move state");
+/**
+ * pieces of both colors standing alone between `king_sq` and
+ * a slider of `slider_clr` aiming at it
+ */
+Bitboard Board::slider_blockers(uint8_t king_sq, Color slider_clr) const
+{
+    const Bitboard queens = get_pieces(slider_clr, P_QUEEN);
+    // sliders that would attack the king on an empty board
+    Bitboard snipers =
+        (rook_attacks(king_sq, 0) & (get_pieces(slider_clr, P_ROOK) | queens))
+        | (bishop_attacks(king_sq, 0) & (get_pieces(slider_clr, P_BISHOP) | queens));
+
+    Bitboard blockers = 0;
+    const Bitboard occupied = get_occupied();
+    while (snipers) {
+        Bitboard between = between_bb(king_sq, pop_lsb(snipers)) & occupied;
+        if (between && (between & (between - 1)) == 0) {
+            blockers |= between;
+        }
     }
-    #endif // DEBUG
+    return blockers;
+}
 
-    // ----------------------------------------
-    // --- HANDLE REMOVING CASTLING RIGHTS ----
-    bool isWhite = move.color == C_WHITE;
-    const uint8_t old_castle_rights = get_castle_rights();
-    uint8_t new_castle_rights = old_castle_rights;
+Bitboard Board::pinned_pieces(Color clr) const
+{
+    return slider_blockers(get_king_pos(clr).to_val(), other_color(clr)) & m_colors[clr];
+}
 
-    // by moving
-    if (move.piece == P_ROOK) {
-        if (move.src.column == 0) {
-            new_castle_rights &= ~(isWhite ? CR_QUEEN_WHITE : CR_QUEEN_BLACK);
+Bitboard Board::discovered_check_candidates(Color clr) const
+{
+    return slider_blockers(get_king_pos(other_color(clr)).to_val(), clr) & m_colors[clr];
+}
+
+/**
+ * `m` must be pseudo-legal: generated for this position,
+ * castling path already checked for attacks
+ */
+bool Board::is_legal(Move m, Bitboard pinned, Bitboard checkers) const
+{
+    const Color clr = get_next_move();
+    const Color them = other_color(clr);
+    const uint8_t king_sq = get_king_pos(clr).to_val();
+    const uint8_t src = m.src_sq();
+    const uint8_t dst = m.dst_sq();
+
+    if (m.is_en_passant()) {
+        // two squares are vacated, look at the resulting occupancy
+        const uint8_t taken_sq = get_en_passant_pos().to_val();
+        Bitboard occupied = (get_occupied() ^ square_bb(src) ^ square_bb(taken_sq))
+            | square_bb(dst);
+        return (attackers_to(king_sq, occupied) & m_colors[them] & ~square_bb(taken_sq)) == 0;
+    }
+    if (src == king_sq) {
+        if (m.is_castling()) {
+            return checkers == 0;
+        }
+        // slider checks must see through the square the king leaves
+        return (attackers_to(dst, get_occupied() ^ square_bb(src)) & m_colors[them]) == 0;
+    }
+    if (checkers) {
+        if (checkers & (checkers - 1)) {
+            return false; // double check, only the king can move
         }
-        else if (move.src.column == 7) {
-            new_castle_rights &= ~(isWhite ? CR_KING_WHITE : CR_KING_BLACK);
+        // capture the checker or block its line
+        if (((checkers | between_bb(king_sq, lsb(checkers))) & square_bb(dst)) == 0) {
+            return false;
         }
     }
-    else if (move.piece == P_KING) {
-        new_castle_rights &= ~(
-            isWhite
-            ? (CR_KING_WHITE|CR_QUEEN_WHITE)
-            :(CR_KING_BLACK|CR_QUEEN_BLACK)
-        );
-    }
-    // by capturing
-    if (move.takes && move.taken_piece == P_ROOK) {
-        if (move.dst.column == 7) {
-            new_castle_rights &= ~(isWhite ? CR_KING_BLACK : CR_KING_WHITE);
-        } else if (move.dst.column == 0) {
-            new_castle_rights &= ~(isWhite ? CR_QUEEN_BLACK : CR_QUEEN_WHITE);
+    if (pinned & square_bb(src)) {
+        return (line_bb(king_sq, src) & square_bb(dst)) != 0;
+    }
+    return true;
+}
+
+/**
+ * check a move from an untrusted source (hash table, killers) against
+ * the position without generating moves, so it can be played before
+ * any generation happens
+ */
+bool Board::is_pseudo_legal(Move m) const
+{
+    const Color clr = get_next_move();
+    const uint8_t src = m.src_sq();
+    const uint8_t dst = m.dst_sq();
+    const uint8_t val = m_mailbox[src];
+
+    if (m.is_none() || val == 0 || (Color)(val >> 3) != clr) {
+        return false;
+    }
+    if (m_colors[clr] & square_bb(dst)) {
+        return false;
+    }
+    const Piece p = (Piece)(val & P_PIECE_MASK);
+    // promotion bits are only set by promotions
+    if (!m.is_promote() && ((m.data >> 12) & 0x3) != 0) {
+        return false;
+    }
+
+    if (m.is_castling()) {
+        if (p != P_KING || src != get_king_pos(clr).to_val() || (src & 7) != 4
+            || (dst != src + 2 && dst + 2 != src)) {
+            return false;
         }
+        return can_castle(*this, clr, dst > src);
     }
+
+    if (p != P_PAWN) {
+        return m.flag() == MF_NORMAL
+            && (piece_attacks(p, clr, src, get_occupied()) & square_bb(dst)) != 0;
+    }
+
+    const int8_t forward = clr == C_WHITE ? 8 : -8;
+    const uint8_t last_row = clr == C_WHITE ? 7 : 0;
+    if (m.is_en_passant()) {
+        return has_en_passant()
+            && dst == get_en_passant_pos().to_val() + forward
+            && (pawn_attacks(clr, src) & square_bb(dst)) != 0;
+    }
+    if (m.is_promote() != ((dst >> 3) == last_row)) {
+        return false;
+    }
+    const Bitboard occupied = get_occupied();
+    if (pawn_attacks(clr, src) & square_bb(dst)) {
+        return (m_colors[other_color(clr)] & square_bb(dst)) != 0;
+    }
+    if (dst == src + forward) {
+        return (occupied & square_bb(dst)) == 0;
+    }
+    // double push from the starting row
+    const uint8_t start_row = clr == C_WHITE ? 1 : 6;
+    return (src >> 3) == start_row
+        && dst == src + 2 * forward
+        && (occupied & (square_bb(src + forward) | square_bb(dst))) == 0;
+}
+
+bool Board::is_legal(Move m) const
+{
+    return is_legal(m, pinned_pieces(get_next_move()), checkers());
+}
+
+int8_t Board::compute_king_checked(Color clr) const
+{
+    return is_square_attacked(get_king_pos(clr), other_color(clr)) ? 1 : 0;
+}
+
+/**
+ * true if a slider of `by_clr` now attacks `king_sq` along the line
+ * going through `vacated_sq`; any slider attack on that kind of line
+ * counts, as the king was known not to be in check before
+ */
+bool Board::is_discovered_check(uint8_t king_sq, uint8_t vacated_sq, Color by_clr) const
+{
+    int drow = (vacated_sq >> 3) - (king_sq >> 3);
+    int dcol = (vacated_sq & 7) - (king_sq & 7);
+    const Bitboard queens = get_pieces(by_clr, P_QUEEN);
+    if (drow == 0 || dcol == 0) {
+        return rook_attacks(king_sq, get_occupied()) & (get_pieces(by_clr, P_ROOK) | queens);
+    }
+    if (std::abs(drow) == std::abs(dcol)) {
+        return bishop_attacks(king_sq, get_occupied()) & (get_pieces(by_clr, P_BISHOP) | queens);
+    }
+    return false;
+}
+
+/**
+ * after the pieces of `move` were moved: derive the check state of both
+ * kings from the moved piece and its source square when the state before
+ * the move is known, otherwise leave it to is_king_checked to compute
+ */
+void Board::update_check_state(Move move, uint32_t flags_before)
+{
+    forget_king_checked();
+    if (move.is_castling() || move.is_en_passant()) {
+        return; // more than one square vacated
+    }
+    const uint8_t src = move.src_sq();
+    const uint8_t dst = move.dst_sq();
+    const Color them = get_next_move();
+    const Color us = other_color(them);
+
+    if (is_known_unchecked(flags_before, them)) {
+        const uint8_t king_sq = get_king_pos(them).to_val();
+        bool direct = (piece_attacks(get_piece_at(dst), us, dst, get_occupied())
+            & square_bb(king_sq)) != 0;
+        cache_king_checked(them, direct || is_discovered_check(king_sq, src, us));
+    }
+    if (get_piece_at(dst) != P_KING && is_known_unchecked(flags_before, us)) {
+        // only a pinned piece moving away can expose our king
+        cache_king_checked(us, is_discovered_check(get_king_pos(us).to_val(), src, them));
+    }
+}
+
+/**
+ * castle rights lost when a piece leaves or lands on given square
+ */
+static constexpr uint8_t castle_rights_mask(uint8_t sq)
+{
+    switch (sq) {
+    case 0: return CR_QUEEN_WHITE;
+    case 4: return CR_KING_WHITE | CR_QUEEN_WHITE;
+    case 7: return CR_KING_WHITE;
+    case 56: return CR_QUEEN_BLACK;
+    case 60: return CR_KING_BLACK | CR_QUEEN_BLACK;
+    case 63: return CR_KING_BLACK;
+    default: return 0;
+    }
+}
+
+uint64_t Board::key_after(Move move) const
+{
+    const uint8_t lost_castle_rights = get_castle_rights()
+        & (castle_rights_mask(move.src_sq()) | castle_rights_mask(move.dst_sq()));
+    uint64_t key = m_key;
+    HashMethods::make_move(*this, key, move, lost_castle_rights);
+    return key;
+}
+
+void Board::make_move(Move move)
+{
+    m_states.push_back(StateInfo{ m_flags, m_key, m_half_move_counter, captured_piece(*this, move) });
+    apply_move(move);
+}
+
+void Board::apply_move(Move move)
+{
+    //check_valid_state();
+
+    const Pos src = move.src();
+    const Pos dst = move.dst();
+    const Color color = get_next_move();
+    const Piece piece = get_piece_at(src);
+    const Piece taken_piece = captured_piece(*this, move);
+    const uint32_t flags_before = m_flags;
+
+    // ----------------------------------------
+    // --- HANDLE REMOVING CASTLING RIGHTS ----
+    // by moving king or rook, or by capturing rook
+    const uint8_t old_castle_rights = get_castle_rights();
+    uint8_t new_castle_rights = old_castle_rights
+        & ~(castle_rights_mask(move.src_sq()) | castle_rights_mask(move.dst_sq()));
     if (new_castle_rights != old_castle_rights) {
         set_castle_rights(new_castle_rights);
     }
@@ -162,42 +372,42 @@ void Board::make_move(const Move& move)
 
     // -------------------------------
     // ------ MOVE PIECES AROUND -----
-    if (move.promote) {
-        set_piece_at(move.dst, move.promote_piece, move.color);
+    if (move.is_promote()) {
+        set_piece_at(dst, move.promote_piece(), color);
     }
     else {
-        set_piece_at(move.dst, move.piece, move.color);
+        set_piece_at(dst, piece, color);
     }
-    set_piece_at(move.src, P_EMPTY, C_BLACK);
-    if (move.en_passant) {
+    set_piece_at(src, P_EMPTY, C_BLACK);
+    if (move.is_en_passant()) {
         set_piece_at(get_en_passant_pos(), P_EMPTY, C_BLACK);
     }
-    if (move.castling) {
-        uint8_t dstCol = move.dst.column;
-        uint8_t row = move.src.row;
+    if (move.is_castling()) {
+        uint8_t dstCol = dst.column;
+        uint8_t row = src.row;
         Pos rook_src{ row, u8(dstCol == 6 ? 7 : 0) };
         Pos rook_dst{ row, u8(dstCol == 6 ? 5 : 3) };
 
         // update rook position
         set_piece_at(rook_src, P_EMPTY, C_BLACK);
-        set_piece_at(rook_dst, P_ROOK, move.color);
+        set_piece_at(rook_dst, P_ROOK, color);
     }
 
     // -------------------------------
     // ------ EN PASSANT STATE -------
-    if (move.piece == P_PAWN && std::abs(move.src.row - move.dst.row) == 2) {
-        set_en_passant_pos(move.dst.column | CAN_EN_PASSANT);
+    if (piece == P_PAWN && std::abs(src.row - dst.row) == 2) {
+        set_en_passant_pos(dst.column | CAN_EN_PASSANT);
     } else {
         set_en_passant_pos(0);
     }
     // -------------------------------
     // -------- SIDE TO MOVE  --------
-    set_next_move(other_color(get_next_move()));
+    set_next_move(other_color(color));
 
 
     // -------------------------------
     // ----- 50 move rule clock  -----
-    if (move.takes || move.piece == P_PAWN) {
+    if (taken_piece != P_EMPTY || piece == P_PAWN) {
         m_half_move_counter = 0;
     }
     else {
@@ -209,71 +419,67 @@ void Board::make_move(const Move& move)
     ++m_ply_count;
 
     // ------------------------------------
-    // ----- CHECK STATE (can be computed)
-    uint8_t checks = (
-        compute_king_checked(C_BLACK)
-        | (compute_king_checked(C_WHITE) << 1u)
-    );
-    set_king_checked(checks);
+    // ----- CHECK STATE
+    update_check_state(move, flags_before);
 
     //check_valid_state();
 
 }
 
-void Board::unmake_move(const Move& move)
+void Board::unmake_move(Move move)
 {
     //check_valid_state();
 
+#ifdef CHESS_DEBUG
+    if (m_states.empty()) {
+        throw chess_exception("unmake_move without matching make_move");
+    }
+#endif
     // -----------------------------------
     // ------ ALL IRREVERSIBLE STATE -----
     // (EN PASSANT/50-M-CLOCK/CASTLING-RIGHTS)
-    m_flags = move.m_board_state_before;
-    m_key = move.m_board_key_before;
-    std::string before_unmake = write_fen_position(*this);
+    const StateInfo st = m_states.back();
+    m_states.pop_back();
+    m_flags = st.flags;
+    m_key = st.key;
+
+    const Pos src = move.src();
+    const Pos dst = move.dst();
+    const Color color = get_next_move();
 
     // -------------------------------
     // ------ MOVE PIECES AROUND -----
-    set_piece_at(move.src, move.piece, move.color);
-    Color clr = move.takes ? other_color(move.color) : C_BLACK;
-    if (move.en_passant) {
-        set_piece_at(get_en_passant_pos(), P_PAWN, clr);
-        set_piece_at(move.dst, P_EMPTY, C_BLACK);
+    set_piece_at(src, move.is_promote() ? P_PAWN : get_piece_at(dst), color);
+    if (move.is_en_passant()) {
+        set_piece_at(get_en_passant_pos(), P_PAWN, other_color(color));
+        set_piece_at(dst, P_EMPTY, C_BLACK);
     } else {
-        set_piece_at(move.dst, move.taken_piece, clr);
+        Color taken_clr = st.taken_piece != P_EMPTY ? other_color(color) : C_BLACK;
+        set_piece_at(dst, st.taken_piece, taken_clr);
     }
-    if (move.castling) {
-        uint8_t dstCol = move.dst.column;
-        uint8_t row = move.src.row;
+    if (move.is_castling()) {
+        uint8_t dstCol = dst.column;
+        uint8_t row = src.row;
         Pos rook_src{ row, u8(dstCol == 6 ? 7 : 0) };
         Pos rook_dst{ row, u8(dstCol == 6 ? 5 : 3) };
-        set_piece_at(rook_src, P_ROOK, move.color);
+        set_piece_at(rook_src, P_ROOK, color);
         set_piece_at(rook_dst, P_EMPTY, C_BLACK);
     }
     --m_ply_count;
-    m_half_move_counter = move.half_move_before;
-
- /*   if (!check_valid_state()) {
-        Board b;
-        std::cerr << "before_unmake=" << before_unmake << "\n";
-        b.load_position(before_unmake);
-        console_draw(b);
-
-        std::cerr << "after_unmake=" << this->get_fen_string() << "\n";
-        console_draw(*this);
-        std::cerr << "here\n";
-    }*/
+    m_half_move_counter = st.half_move;
 }
 
 
-void Board::make_null_move(NullMove& m)
+void Board::make_null_move()
 {
     //check_valid_state();
 
+    m_states.push_back(StateInfo{ m_flags, m_key, m_half_move_counter, P_EMPTY });
     ++m_ply_count;
 
     // ------------------------
     // --- UPDATE HASH KEY ----
-    HashMethods::make_null_move(*this, m_key, m);
+    HashMethods::make_null_move(*this, m_key);
 
     // -------------------------------
     // -------- SIDE TO MOVE  --------
@@ -289,15 +495,16 @@ void Board::make_null_move(NullMove& m)
 
 }
 
-void Board::unmake_null_move(NullMove& m)
+void Board::unmake_null_move()
 {
     //check_valid_state();
 
+    const StateInfo st = m_states.back();
+    m_states.pop_back();
     --m_ply_count;
-    set_next_move(other_color(get_next_move()));
-    m_key = m.m_board_key_before;
-    m_flags = m.m_board_state_before;
-    m_half_move_counter = m.half_move_before;
+    m_key = st.key;
+    m_flags = st.flags;
+    m_half_move_counter = st.half_move;
 
     //check_valid_state();
 }
@@ -305,16 +512,16 @@ void Board::unmake_null_move(NullMove& m)
 bool Board::check_valid_state()
 {
     uint8_t count_piece[6 * 2] = { 0,0 };
-    for (uint8_t i = 0; i < 64; ++i)
+    for (uint8_t c = 0; c < 2; ++c)
     {
-        Color clr = get_color_at(i);
-        Piece piece = get_piece_at(i);
-
-        if (clr != C_EMPTY)
+        for (uint8_t p = P_MIN_PIECE; p <= P_MAX_PIECE; ++p)
         {
-            ++count_piece[clr * 6 + (piece-1)];
+            count_piece[c * 6 + (p-1)] = popcount(get_pieces((Color)c, (Piece)p));
         }
     }
+    if ((m_colors[C_BLACK] & m_colors[C_WHITE]) != 0) {
+        return false;
+    }
     for (uint8_t c = 0; c < 2; ++c)
     {
         if (count_piece[c * 6 + P_PAWN-1] > 8) {
@@ -4,30 +4,56 @@
 #include <algorithm>
 #include <cinttypes>
 #include <string>
+#include <vector>
 
 class Board;
 struct Move;
-struct NullMove;
 
 #include "./types.hpp"
+#include "./bitboard.hpp"
 #include "./transposition_table.hpp"
 
 std::string write_fen_position(const Board&);
 enum {
     CAN_EN_PASSANT = 8,
+    STATE_STACK_RESERVE = 256, // plies preallocated for the undo stack
 };
 
-class Board
+/**
+ * irreversible state of the board, pushed by make_move
+ * and popped by unmake_move
+ */
+struct StateInfo
+{
+    uint32_t flags;
+    uint64_t key;
+    uint8_t half_move;
+    Piece taken_piece;
+};
+
+/**
+ * cache line aligned so that copy-make copies whole lines,
+ * all the position is stored before the undo stack
+ */
+class alignas(64) Board
 {
 private:
-    uint8_t m_board[32];
+    // one occupancy set per piece type (indexed by Piece, P_EMPTY unused)
+    // and per color, plus a mailbox for O(1) lookup of a single square
+    Bitboard m_pieces[P_NUM_PIECE];
+    Bitboard m_colors[2];
+    uint8_t m_mailbox[64]; // piece | (color << 3), 0 is empty square
     //std::string m_position;
     uint16_t m_ply_count;
     uint8_t m_half_move_counter; // for 50 moves rule
 
-    uint32_t m_flags;
+    // check bits are a cache filled on demand by is_king_checked
+    mutable uint32_t m_flags;
     uint64_t m_key;
 
+    // one entry per move made, so moves do not carry restore data
+    std::vector<StateInfo> m_states;
+
     enum IDX {
         KING_POS_I = 0,
         //KING_POS_LENGTH = 12,
@@ -39,6 +65,8 @@ private:
         //KING_CHECKED_LENGTH = 2,
         NEXT_COLOR_I = 22,
         //NEXT_COLOR_LENGTH = 1,
+        CHECK_KNOWN_I = 23,
+        //CHECK_KNOWN_LENGTH = 2,
 
     };
     //unsigned m_king_pos : 12; // 6 black + 6 white
@@ -46,14 +74,31 @@ private:
     //unsigned m_en_passant_file : 4; //3(file) + 1 (boolean)
     //unsigned m_king_checked : 2; // 1 black + 1 white
     //unsigned m_next_color_to_move : 1;
+    //unsigned m_check_known : 2; // KING_CHECKED bit is valid, per color
 
 
-    //  12 + 4 + 4 + 2 + 1= 23
+    //  12 + 4 + 4 + 2 + 1 + 2 = 25
 
-    int8_t compute_king_checked(Color);
+    int8_t compute_king_checked(Color) const;
+    bool is_discovered_check(uint8_t king_sq, uint8_t vacated_sq, Color by_clr) const;
+    void update_check_state(Move move, uint32_t flags_before);
+
+    /* true if `flags` record that the king of `clr` is not in check */
+    static bool is_known_unchecked(uint32_t flags, Color clr) {
+        return ((flags >> (CHECK_KNOWN_I + (uint32_t)clr)) & 1u) != 0
+            && ((flags >> (KING_CHECKED_I + (uint32_t)clr)) & 1u) == 0;
+    }
+    void cache_king_checked(Color clr, bool checked) const {
+        m_flags = (m_flags & ~(1u << (KING_CHECKED_I + (uint32_t)clr)))
+            | ((uint32_t)checked << (KING_CHECKED_I + (uint32_t)clr))
+            | (1u << (CHECK_KNOWN_I + (uint32_t)clr));
+    }
+    void forget_king_checked() { m_flags &= ~(0x3u << CHECK_KNOWN_I); }
 
 public:
-    Board():
+    Board() : Board(STATE_STACK_RESERVE) {}
+    /* undo stack preallocated for `reserved_plies` moves */
+    explicit Board(size_t reserved_plies):
         m_ply_count{0},
         m_half_move_counter{0},
         m_flags{ 0 },
@@ -63,13 +108,40 @@ public:
         m_king_checked{ 0 },
         m_next_color_to_move{ C_WHITE }*/
     {
-        std::fill(std::begin(m_board), std::end(m_board), 0);
+        std::fill(std::begin(m_pieces), std::end(m_pieces), 0);
+        std::fill(std::begin(m_colors), std::end(m_colors), 0);
+        std::fill(std::begin(m_mailbox), std::end(m_mailbox), 0);
+        m_states.reserve(reserved_plies);
     }
 
+    /* take the position of `o` but not its undo stack (copy-make) */
+    void copy_position(const Board& o)
+    {
+        std::copy(std::begin(o.m_pieces), std::end(o.m_pieces), m_pieces);
+        std::copy(std::begin(o.m_colors), std::end(o.m_colors), m_colors);
+        std::copy(std::begin(o.m_mailbox), std::end(o.m_mailbox), m_mailbox);
+        m_ply_count = o.m_ply_count;
+        m_half_move_counter = o.m_half_move_counter;
+        m_flags = o.m_flags;
+        m_key = o.m_key;
+    }
+
+    /* make sure `plies` more moves can be made without growing the undo stack */
+    void reserve_plies(size_t plies) { m_states.reserve(m_states.size() + plies); }
+
     /* read board state */
     bool check_valid_state();
-    Piece get_piece_at(const Pos& pos) const;
-    Color get_color_at(const Pos& pos) const;
+    Piece get_piece_at(const Pos& pos) const {
+        return (Piece)(m_mailbox[pos.to_val()] & P_PIECE_MASK);
+    }
+    Color get_color_at(const Pos& pos) const {
+        uint8_t val = m_mailbox[pos.to_val()];
+        return val == 0 ? C_EMPTY : (Color)(val >> 3);
+    }
+    Bitboard get_pieces(Piece p) const { return m_pieces[p]; }
+    Bitboard get_pieces(Color c, Piece p) const { return m_pieces[p] & m_colors[c]; }
+    Bitboard get_color_pieces(Color c) const { return m_colors[c]; }
+    Bitboard get_occupied() const { return m_colors[C_BLACK] | m_colors[C_WHITE]; }
     Color get_next_move() const { return (Color)((m_flags >> NEXT_COLOR_I) & 1); }
     uint8_t get_castle_rights() const { return (uint8_t)(m_flags >> CASTLE_I) & (0x0F); }
 
@@ -87,10 +159,14 @@ public:
     uint32_t get_flags() const { return m_flags;  }
     std::string get_key_string() const { return HashMethods::to_string(get_key()); }
     uint64_t get_key() const { return m_key; }
+    /* key of the position reached by `move`, without playing it */
+    uint64_t key_after(Move move) const;
 
     bool is_king_checked(Color clr) const {
-        auto val = (m_flags >> KING_CHECKED_I) & 0x3;
-        return (val & (1<<clr)) != 0;
+        if ((m_flags & (1u << (CHECK_KNOWN_I + (uint32_t)clr))) == 0) {
+            cache_king_checked(clr, compute_king_checked(clr) != 0);
+        }
+        return (m_flags & (1u << (KING_CHECKED_I + (uint32_t)clr))) != 0;
     }
 
     Pos get_king_pos(Color clr) const {
@@ -100,13 +176,26 @@ public:
     std::string get_pos_string() const { return write_fen_position(*this); }
     std::string get_fen_string() const { return write_fen_position(*this); }
 
-    bool is_square_attacked(const Pos& pos, Color clr);
+    Bitboard attackers_to(uint8_t sq, Bitboard occupied) const;
+    bool is_square_attacked(const Pos& pos, Color clr) const;
+    bool is_any_square_attacked(Bitboard squares, Color clr) const;
+
+    /* pieces giving check to the side to move */
+    Bitboard checkers() const;
+    Bitboard slider_blockers(uint8_t king_sq, Color slider_clr) const;
+    /* pieces of `clr` that cannot leave the line to their king */
+    Bitboard pinned_pieces(Color clr) const;
+    /* pieces of `clr` whose move may uncover a check on the enemy king */
+    Bitboard discovered_check_candidates(Color clr) const;
+    /* legality of a pseudo-legal move of the side to move, masks from above */
+    bool is_legal(Move m, Bitboard pinned, Bitboard checkers) const;
+    /* `m` could have been generated in this position (TT, killers, ...) */
+    bool is_pseudo_legal(Move m) const;
+    /* full legality test of a pseudo-legal move */
+    bool is_legal(Move m) const;
 
 
     /* update board state */
-    void set_king_checked(uint8_t val) {
-        m_flags = (m_flags & ~(0x3u << KING_CHECKED_I)) ^ (val << KING_CHECKED_I);
-    }
     void set_king_pos(const Pos &p, Color c) {
         uint8_t x = p.column + p.row * 8;
 
@@ -136,12 +225,14 @@ public:
     void load_position(const std::string& fen_position);
 
     /* make a move ! */
-    void make_move(const Move& move);
-    void unmake_move(const Move& move);
+    void make_move(Move move);
+    void unmake_move(Move move);
+    /* make a move that is never unmade (copy-make), no undo state saved */
+    void apply_move(Move move);
 
     /* dont make a move ! */
-    void make_null_move(NullMove& m);
-    void unmake_null_move(NullMove& m);
+    void make_null_move();
+    void unmake_null_move();
 }; // class Board
 
 
@@ -306,10 +306,7 @@ void BoardRenderer::draw_candidates_moves() const
 {
     SDL_SetRenderDrawColor(m_renderer, 100, 240, 100, 0xFF);
     for (const auto& m : m_candidates_moves) {
-        if (!m.legal) {
-            continue;
-        }
-        Pos p = m.dst;
+        Pos p = m.dst();
         if (m_flipped_board) {
             p.column = 7 - p.column;
             p.row = 7 - p.row;
@@ -354,13 +351,17 @@ void BoardRenderer::prepare_player_move(Board &b, SDL_Event &e)
     Color to_move = b.get_next_move();
 
     if (clr == to_move) {
-        m_candidates_moves.clear();
-        add_move_from_position(b, pos, m_candidates_moves, false);
+        MoveList moves;
+        add_move_from_position(b, pos, moves, false);
 
-        for (auto& m : m_candidates_moves)
+        // only keep legal moves
+        m_candidates_moves.clear();
+        for (Move m : moves)
         {
             b.make_move(m);
-            m.legal = !b.is_king_checked(to_move);
+            if (!b.is_king_checked(to_move)) {
+                m_candidates_moves.push_back(m);
+            }
             b.unmake_move(m);
         }
         m_need_redraw = true;
@@ -382,9 +383,9 @@ void BoardRenderer::do_player_move(Board &b, SDL_Event &e)
     Pos pos{ row, col };
 
     bool player_move_done = false;
-    for (const auto & m : m_candidates_moves) {
-        if (m.legal && pos == m.dst) {
-            if (m.promote && m.promote_piece != P_QUEEN) {
+    for (Move m : m_candidates_moves) {
+        if (pos == m.dst()) {
+            if (m.is_promote() && m.promote_piece() != P_QUEEN) {
                 continue;
             }
             b.make_move(m);
@@ -476,23 +477,9 @@ void BoardRenderer::main_loop(Board &b, NegamaxEngine &engine)
                 std::cout << "loading history in PV!\n";
                 int32_t eval = evaluate_board(b);
                 Color clr = b.get_next_move();
-                if (b.is_king_checked(clr))
+                if (b.is_king_checked(clr) && !has_legal_move(b))
                 {
-                    MoveList moves;
-                    generate_pseudo_moves(moves, b);
-                    int32_t num_legal_moves = 0;
-                    for (auto& m : moves)
-                    {
-                        b.make_move(m);
-                        if (!b.is_king_checked(clr))
-                        {
-                            ++num_legal_moves;
-                        }
-                        b.unmake_move(m);
-                    }
-                    if (num_legal_moves == 0) {
-                        eval = -20000 + (int32_t)m_history.size();
-                    }
+                    eval = -20000 + (int32_t)m_history.size();
                 }
                 engine.clear_hash();
 
@@ -503,13 +490,13 @@ void BoardRenderer::main_loop(Board &b, NegamaxEngine &engine)
                     b.unmake_move(m_history[i - 1]);
                     eval = -eval;
 
-                    auto& entry = engine.m_hash.get(b.get_key());
-                    entry.depth = 2;
-                    entry.key = b.get_key();
-                    entry.node_type = NodeType::PV_NODE;
-                    entry.score = eval;
-                    entry.hashmove_dst = m_history[i - 1].dst.to_val();
-                    entry.hashmove_src = m_history[i - 1].src.to_val();
+                    HashEntry entry;
+                    HashSlot* slot;
+                    engine.m_hash.probe(b.get_key(), entry, slot);
+                    entry.save(
+                        b.get_key(), m_history[i - 1].data, eval, 2,
+                        NodeType::PV_NODE, false, engine.m_hash.generation());
+                    slot->store(entry);
 
                 }
                 draw(b);
@@ -566,7 +553,7 @@ void BoardRenderer::main_loop(Board &b, NegamaxEngine &engine)
                     {
                         pgn::load_pgn_file(content, b, move_history);
                         m_history_mode = false;
-                        m_history = move_history;
+                        m_history.assign(move_history.begin(), move_history.end());
 
                     }
                     catch (chess_exception& e)
@@ -576,7 +563,7 @@ void BoardRenderer::main_loop(Board &b, NegamaxEngine &engine)
 
                     for (auto& m : move_history)
                     {
-                        std::cout << "move=" << move_to_string(m) << "\n";
+                        std::cout << "move=" << move_to_uci_string(m) << "\n";
                     }
 
                 }
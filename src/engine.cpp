@@ -11,6 +11,8 @@
 #include "./timer.hpp"
 #include "./evaluation.hpp"
 #include "./uci.hpp"
+#include "./attacks.hpp"
+#include "./alloc_audit.hpp"
 
 
 bool is_exact_score(NodeType type)
@@ -40,40 +42,23 @@ void NegamaxEngine::handle_no_move_available(Board &b)
 
     uci_send_info_string("engine abnormal state => sending a random move ! :(");
     MoveList ml;
-    generate_pseudo_moves(ml, b, false);
+    generate_legal_moves(ml, b);
     if (ml.size() == 0) {
         uci_send_nullmove();
     }
     else {
-        Color clr = b.get_next_move();
-        for (auto& m : ml) {
-            b.make_move(m);
-
-            m.legal_checked = true;
-            m.legal = !b.is_king_checked(clr);
-            m.score = -999999;
-            if (m.legal) {
-                m.score = piece_value(m.taken_piece) - piece_value(m.piece);
-            }
-            b.unmake_move(m);
+        for (size_t i = 0; i < ml.size(); ++i) {
+            Move m = ml[i];
+            ml.score(i) = piece_value(captured_piece(b, m)) - piece_value(moved_piece(b, m));
         }
-        std::sort(
-            ml.begin(), ml.end(),
-            [](const auto& a, const auto& b) {return a.score > b.score; }
-        );
+        ml.sort();
         uci_send_bestmove(ml[0]);
     }
 }
 
-void extract_pv(const Move& m, const MoveList& currentPvLine, MoveList& parentPvLine)
+void extract_pv(Move m, const PvLine& currentPvLine, PvLine& parentPvLine)
 {
-    parentPvLine.resize(currentPvLine.size() + 1);
-
-    parentPvLine[0] = m;
-    auto size = currentPvLine.size();
-    for (size_t i = 0; i < size; ++i) {
-        parentPvLine[i + 1] = currentPvLine[i];
-    }
+    parentPvLine.set(m, currentPvLine);
 }
 
 int32_t NegamaxEngine::quiesce(
@@ -91,6 +76,11 @@ int32_t NegamaxEngine::quiesce(
     if (m_stop_required) {
         return beta; // fail-high immediately
     }
+    m_seldepth = std::max(m_seldepth, ply);
+    if (ply >= MAX_PLY - 1) {
+        // no room left in fixed size per-ply buffers
+        return color * evaluate_board(b);
+    }
 
     if (allow_standpat) {
         TIME_IT(m_evaluation_timer);
@@ -124,59 +114,64 @@ int32_t NegamaxEngine::quiesce(
     }
 
     MoveList moveList;
-    TIME_IT(m_move_generation2_timer);
-    generate_pseudo_moves(moveList, b,  allow_standpat);
-    UNTIL_THERE;
-
-
-    TIME_IT(m_move_ordering_mvv_lva_timer);
-    // quick ordering
     if (allow_standpat) {
-        reorder_mvv_lva(moveList, 0, moveList.size());
-    } else {
-        reorder_moves(
-            *this, b, moveList, ply, -1, m_killers,
-            false, node.hash_move, m_history
-        );
-    }
-    //reorder_see(b, moveList, 0, moveList.size());
-    UNTIL_THERE;
+        TIME_IT(m_move_generation2_timer);
+        // captures only need pins and checkers, not the attack maps
+        generate_legal_moves(moveList, b, GT_CAPTURES);
+        UNTIL_THERE;
 
-    int32_t num_legal_move = 0;
-    for (auto& move : moveList) {
-        TIME_IT(m_make_move2_timer);
-        b.make_move(move);
+        TIME_IT(m_move_ordering_mvv_lva_timer);
+        // quick ordering
+        reorder_mvv_lva(b, moveList, 0, moveList.size());
+        //reorder_see(b, moveList, 0, moveList.size());
         UNTIL_THERE;
+    }
+    else {
+        // all evasions, ordered like in regular nodes
+        const AttackInfo ai(b);
+        Move prev_move = ply > 0 ? m_move_stack[ply - 1] : Move{};
+        MovePicker picker(
+            b, ai, Move{}, m_killers, ply, counter_move(b, prev_move), m_history);
+        Move move;
+        int32_t order_score;
+        while (picker.next(move, order_score)) {
+            moveList.push_back(move);
+        }
+    }
 
-        move.legal_checked = true;
-        move.legal = !b.is_king_checked(move.color);
-        if (!move.legal)
-        {
-            TIME_IT2(m_unmake_move2_timer);
-            b.unmake_move(move);
+    int32_t num_legal_move = 0;
+    Color clr = b.get_next_move();
+    for (Move move : moveList) {
+        // losing captures are left to the full width search
+        if (allow_standpat && !see_ge(b, move, 0)) {
             continue;
         }
+        int32_t pval = piece_value(captured_piece(b, move));
+        Board* child_board = &b;
+        TIME_IT(m_make_move2_timer);
+        child_board = &make_search_move(b, move, ply);
+        UNTIL_THERE;
+        m_move_stack[ply] = move;
         ++num_legal_move;
 
         int32_t BIG_DELTA = 975;
-        if (move.promote) {
+        if (move.is_promote()) {
             BIG_DELTA += 775;
         }
-        int32_t pval = piece_value(move.taken_piece);
         if (allow_standpat && ((pval + BIG_DELTA) < alpha)) {
             TIME_IT2(m_unmake_move2_timer);
-            b.unmake_move(move);
+            unmake_search_move(b, move);
             //return alpha;
             return standing_pat;
         }
         Node child;
-        child.in_check = b.is_king_checked(other_color(move.color));
-        int32_t val = -quiesce(child, b, -color, -beta, -alpha, ply+1, qply+1);
+        child.in_check = child_board->is_king_checked(other_color(clr));
+        int32_t val = -quiesce(child, *child_board, -color, -beta, -alpha, ply+1, qply+1);
         TIME_IT(m_unmake_move2_timer);
-        b.unmake_move(move);
+        unmake_search_move(b, move);
         UNTIL_THERE;
         if (val >= beta) {
-            update_cut_heuristics(move, node, ply);
+            update_cut_heuristics(b, move, val, ply);
             //return beta;
             node.type = NodeType::CUT_NODE;
             node.score = val;
@@ -187,7 +182,6 @@ int32_t NegamaxEngine::quiesce(
             node.score = val;
             node.type = NodeType::PV_NODE;
         }
-        move.score = val;
         if (m_stop_required) {
             if (node.type == NodeType::UNDEFINED) {
                 node.type = NodeType::CUT_NODE;
@@ -215,55 +209,46 @@ bool NegamaxEngine::lookup_hash(
     int32_t remaining_depth, int32_t ply,
     int32_t alpha, int32_t beta, Node &pnode)
 {
-    auto &hashentry = m_hash.get(node.zkey);
-
-    if (hashentry.key == node.zkey) {
-        node.has_hash_move = hashentry.hashmove_src != hashentry.hashmove_dst;
+    ++stats.num_hash_probes;
+    HashEntry hashentry;
+    HashSlot* slot;
+    if (m_hash.probe(node.zkey, hashentry, slot)) {
+        Move hash_move{ hashentry.hash_move };
+        node.has_hash_move = !hash_move.is_none();
         bool had_hash_move = node.has_hash_move;
         if (node.has_hash_move)
         {
-            node.has_hash_move = generate_move_for_squares(
-                b, hashentry.hashmove_src,
-                hashentry.hashmove_dst,
-                hashentry.promote_piece,
-                node.hash_move
-            );
+            node.hash_move = hash_move;
+            node.has_hash_move = b.is_pseudo_legal(hash_move) && b.is_legal(hash_move);
         }
 #ifdef CHESS_DEBUG
         if (had_hash_move && !node.has_hash_move) {
-            std::string newfen = b.get_fen_string();
-            std::string oldfen = hashentry.fen;
-            bool different_fen = newfen != oldfen;
-            Board bnew, bold;
-            bnew.load_position(newfen);
-            bold.load_position(oldfen);
-            std::cerr << fmt::format("new FEN = {}???\n", oldfen);
-            console_draw(bnew);
-            std::cerr << fmt::format("old FEN = {}???\n", newfen);
-            console_draw(bold);
-            std::cerr << fmt::format("is that an HASH KEY CONFLICT = {}???\n", different_fen);
-            std::cerr << "\n";
+            // only 16 bits of the key are stored
+            std::cerr << fmt::format("HASH KEY CONFLICT? illegal hash move {} in FEN = {}\n",
+                                     move_to_uci_string(hash_move), b.get_fen_string());
         }
+#else
+        (void)had_hash_move;
 #endif
 
         if (ply == 0) {
             m_has_current_root_evaluation = true;
             m_current_root_evaluation = hashentry.score;
-            std::cerr << "current_root_evaluation=" << hashentry.score << "\n";
+            fmt::print(stderr, "current_root_evaluation={}\n", hashentry.score);
         }
 
         if (hashentry.depth >= remaining_depth) {
-            if (is_exact_score(hashentry.node_type )) {
+            if (is_exact_score(hashentry.node_type())) {
                 ++stats.num_hash_hits;
                 node.score = hashentry.score;
                 if (node.has_hash_move && node.score > alpha && node.score < beta) {
                     node.pvLine.clear();
                     extract_pv_from_tt(b, node.pvLine, hashentry.depth, ply);
-                    pnode.pvLine = std::move(node.pvLine);
+                    pnode.pvLine = node.pvLine;
                 }
                 return true;
             }
-            else if (hashentry.node_type == NodeType::CUT_NODE) {
+            else if (hashentry.node_type() == NodeType::CUT_NODE) {
                 /* node score is lower bound of (lower than) real node score*/
                 /* real score might be greater */
                 if (hashentry.score >= beta) {
@@ -273,7 +258,7 @@ bool NegamaxEngine::lookup_hash(
                     return true;
                 }
             }
-            else if (hashentry.node_type == NodeType::ALL_NODE) {
+            else if (hashentry.node_type() == NodeType::ALL_NODE) {
                 /* node score is upper bound of (greater than) real node score*/
                 /* real score might be lower */
                 if (hashentry.score <= alpha) {
@@ -284,7 +269,7 @@ bool NegamaxEngine::lookup_hash(
                 }
             }
         }
-    } else if (hashentry.key != 0 && hashentry.key != node.zkey) {
+    } else if (!hashentry.is_empty()) {
         ++stats.num_hash_conflicts;
     }
     return false;
@@ -293,21 +278,25 @@ bool NegamaxEngine::lookup_hash(
 void NegamaxEngine::update_hash(
     Node &node, Stats &stats, int depth)
 {
-    auto &hashentry = m_hash.get(node.zkey);
-
-    bool replace = hashentry.key == 0
-        || depth > hashentry.depth
-        || (!is_exact_score(hashentry.node_type) && is_exact_score(node.type));
-
-    // if depth is lower but we have an pv-node
-    // while the previous was not a pv-node then replace!
-    if (node.null_window) {
-        // if in a null windows
-        // we replace if is empty or if the entry is that of a null window
-        // and we would otherwise replace
-        replace = (hashentry.is_null_window && replace) || hashentry.key == 0;
-    } else if (hashentry.is_null_window) {
-        replace = true;
+    HashEntry hashentry;
+    HashSlot* slot;
+    // another position only gets the slot the table picked for eviction,
+    // the same position follows the depth/exactness/null window rules
+    bool replace = true;
+    if (m_hash.probe(node.zkey, hashentry, slot)) {
+        replace = depth > hashentry.depth
+            || (!is_exact_score(hashentry.node_type()) && is_exact_score(node.type));
+
+        // if depth is lower but we have an pv-node
+        // while the previous was not a pv-node then replace!
+        if (node.null_window) {
+            // if in a null windows
+            // we replace if the entry is that of a null window
+            // and we would otherwise replace
+            replace = hashentry.is_null_window() && replace;
+        } else if (hashentry.is_null_window()) {
+            replace = true;
+        }
     }
     //if (node.found_best_move && (node.best_move.mate||node.best_move.pat)) {
     //    replace = true;
@@ -318,22 +307,17 @@ void NegamaxEngine::update_hash(
     //    // because this is a `real` terminal node
     //}
 
-    if (replace) {
-        hashentry.score = node.score;
-        //hashentry.fen = b.get_fen_string();
-        hashentry.depth = depth;
-        hashentry.key = node.zkey;
-        hashentry.is_null_window = node.null_window;
-        hashentry.node_type = node.type;
-        if (node.found_best_move) {
-            hashentry.hashmove_src = node.best_move.src.to_val();
-            hashentry.hashmove_dst = node.best_move.dst.to_val();
-            hashentry.promote_piece = node. best_move.promote_piece;
-        }
-        else {
-            hashentry.hashmove_src = 0;
-            hashentry.hashmove_dst = 0;
+    if (replace && node.type != NodeType::UNDEFINED) {
+        ++stats.num_hash_stores;
+        if (!hashentry.is_empty() && !hashentry.matches(node.zkey)) {
+            ++stats.num_hash_overwrites;
+            stats.num_hash_stale_overwrites += hashentry.age(m_hash.generation()) != 0;
         }
+        HashEntry stored;
+        stored.save(
+            node.zkey, node.found_best_move ? node.best_move.data : 0,
+            node.score, depth, node.type, node.null_window, m_hash.generation());
+        slot->store(stored);
     }
 
     if (node.type == NodeType::CUT_NODE) { ++stats.num_cut_nodes; }
@@ -342,33 +326,38 @@ void NegamaxEngine::update_hash(
 }
 
 int32_t compute_move_extensions(Node& node, int max_depth, int ply, int remaining_depth,
-                            const Move& move, size_t num_moves)
+                            bool gives_check, size_t num_moves)
 {
     int32_t e = 0;
-    if ((node.in_check || move.checks) && remaining_depth <= 2 && ply < max_depth +4) {
+    if ((node.in_check || gives_check) && remaining_depth <= 2 && ply < max_depth +4) {
         e = 0;
     }
     return e;
 }
 
-int32_t compute_late_move_reductions(Node &node, int remaining_depth, const Move &move, size_t num_moves)
+/**
+ * `order_score` is the score given by the MovePicker,
+ * its band tells if the move is a killer, a good capture, ...
+ */
+int32_t compute_late_move_reductions(
+    Node &node, int remaining_depth, Move move, bool gives_check,
+    int32_t order_score, size_t num_moves)
 {
     int32_t r = 0;
     // LATE MOVE REDUCTIONS
     if (remaining_depth > 2
-        && !move.checks
-        && !move.killer
-        && move.see_value <= 0 // only quiet or loosing capture ??
+        && !gives_check
+        && order_score < KILLER_SCORE // only quiet or loosing capture ??
         // maybe i should not reduce captures
         && node.num_legal_move > 5
-        && !move.promote)
+        && !move.is_promote())
     {
         r = 1;
         if (num_moves >= 30 && node.num_legal_move >= num_moves - 10)
         {
             r = 2;
             if (num_moves >= 40
-                && move.see_value < 0
+                && order_score < 0 // loosing capture
                 && node.num_legal_move >= num_moves - 5)
             {
                 r = 3;
@@ -402,41 +391,43 @@ NodeType expected_node_type(const Node &node, bool hashmove)
 }
 
 
-void NegamaxEngine::update_cut_heuristics(Move &move, Node &node, int32_t ply)
+/**
+ * called after a beta cutoff, with move unmade from the board
+ */
+void NegamaxEngine::update_cut_heuristics(Board& b, Move move, int32_t score, int32_t ply)
 {
-    if (!move.takes) {
+    if (!is_capture(b, move)) {
         // update killers
-        move.killer = true;
-        bool was_mate_killer = move.mate_killer;
-        move.mate_killer = move.score >= 20000 - 300;
-        // if (move.mate_killer && !was_mate_killer) {
-        //     std::cerr << fmt::format("\nfound new mate killer={} ply={}\n", move_to_string(move), ply);
+        Killer killer{ move, score >= 20000 - 300 };
+        // if (killer.mate) {
+        //     std::cerr << fmt::format("\nfound new mate killer={} ply={}\n", move_to_uci_string(move), ply);
         // }
-        bool already_in = false;
-        if (m_killers.size() < ply + 1) {
-            m_killers.resize(ply + 1);
-        }
         auto& killers = m_killers[ply];
-        // replace killer
-        for (auto& m : killers) {
-            if (m == move) {
-                already_in = true;
-                break;
-            }
-        }
+        bool already_in = std::any_of(
+            killers.begin(), killers.end(),
+            [move](const Killer& k) { return k.move == move; });
 
         if (!already_in) {
-            killers.push_back(move);
-            while (killers.size() > 3) {
-                // pop back
-                killers.erase(killers.begin());
+            auto slot = std::find_if(
+                killers.begin(), killers.end(),
+                [](const Killer& k) { return k.move.is_none(); });
+            if (slot == killers.end()) {
+                // all slots taken, forget the oldest one
+                std::rotate(killers.begin(), killers.begin() + 1, killers.end());
+                slot = killers.end() - 1;
             }
+            *slot = killer;
         }
 
         // update history
-        auto clr = move.color;
-        size_t idx = clr * 64 * 64 + move.src.to_val() * 64 + move.dst.to_val();
+        auto clr = b.get_next_move();
+        size_t idx = clr * 64 * 64 + move.src_sq() * 64 + move.dst_sq();
         m_history[idx] += ply * ply;
+
+        if (ply > 0) {
+            Move prev = m_move_stack[ply - 1];
+            m_counter_moves[other_color(clr) * 64 * 64 + prev.src_sq() * 64 + prev.dst_sq()] = move;
+        }
     }
 }
 
@@ -454,6 +445,12 @@ int32_t NegamaxEngine::negamax(
     if (m_stop_required) {
         return beta; // fail-high immediately
     }
+    m_seldepth = std::max(m_seldepth, ply);
+    if (ply >= MAX_PLY - 1) {
+        // no room left in fixed size per-ply buffers
+        node.score = color * evaluate_board(b);
+        return node.score;
+    }
 
     // check for 50moves
     if (b.get_half_move() >= 99) {
@@ -464,10 +461,6 @@ int32_t NegamaxEngine::negamax(
 
     // checks for repetition
     uint64_t zkey = b.get_key();
-    auto psize = m_positions_sequence.size();
-    if (psize < ply + 1) {
-        m_positions_sequence.resize(ply + 1);
-    }
     m_positions_sequence[ply] = zkey;
     for (size_t i = ply; i > 0; --i) {
         if (m_positions_sequence[i-1] == zkey) {
@@ -485,7 +478,7 @@ int32_t NegamaxEngine::negamax(
     }
     Color clr = b.get_next_move();
     node.in_check = b.is_king_checked(clr);
-    auto& stats = m_stats[max_depth][ply];
+    auto& stats = stats_at(max_depth, ply);
 
     node.zkey = zkey;
     node.null_window = beta == alpha + 1;
@@ -511,231 +504,166 @@ int32_t NegamaxEngine::negamax(
     //}
 
     m_regular_nodes += 1;
+    if ((m_regular_nodes & 1023) == 0) {
+        send_periodic_info(max_depth);
+    }
     node.score = -999999;
     node.num_legal_move = 0;
     node.num_move_maked = 0;
     node.type = NodeType::UNDEFINED;
 
-    if (node.has_hash_move) {
-        Node child;
-        child.expected_type = expected_node_type(node, true);
-        if (ply == 0) {
-            //send_currmove(max_depth, node.hash_move, 1);
-            //std::cerr << fmt::format(
-            //    "depth={} move={} HASHMOVE ",
-            //    max_depth, move_to_string(node.hash_move));
+    const AttackInfo ai(b);
+    Move prev_move = ply > 0 ? m_move_stack[ply - 1] : Move{};
+    MovePicker picker(
+        b, ai, node.has_hash_move ? node.hash_move : Move{}, m_killers, ply,
+        counter_move(b, prev_move), m_history
+    );
+    Move move;
+    int32_t order_score;
+    while (true)
+    {
+        bool has_move = false;
+        TIME_IT(m_move_ordering_timer);
+        has_move = picker.next(move, order_score);
+        UNTIL_THERE;
+        if (!has_move) {
+            break;
         }
 
-        b.make_move(node.hash_move);
-        node.hash_move.checks = b.is_king_checked(other_color(clr));
-
-        // check legality here ???
+        // the child probes the table first thing, its bucket
+        // loads while the move is played and draws are checked
+        m_hash.prefetch(b.key_after(move));
 
-        ++node.num_legal_move;
+        Board* child_board = &b;
+        TIME_IT(m_make_move_timer);
+        child_board = &make_search_move(b, move, ply);
+        UNTIL_THERE;
+        m_move_stack[ply] = move;
         ++node.num_move_maked;
 
-        int32_t val = -negamax(
-            node, child, b, max_depth, remaining_depth - 1, ply + 1,
-            -color, -beta, -alpha, internal );
-        b.unmake_move(node.hash_move);
-
-        node.hash_move.score = val;
-        node.hash_move.mate = child.type == NodeType::MATE;
-        node.hash_move.pat = child.type == NodeType::PAT;
-
-        if (val > node.score) {
-            node.score = val;
-            node.best_move = node.hash_move;
-            node.found_best_move = true;
-        }
-
-        if (val >= beta) {
-            // cut node ! yay !
-            node.type = NodeType::CUT_NODE;
-            update_cut_heuristics(node.hash_move, node, ply);
-            stats.num_cut_by_hash_move += 1;
-        }
-        else if (val > alpha) {
-            alpha = val;
-            node.type = NodeType::PV_NODE;
-            node.use_aspiration = true;
-            extract_pv(node.hash_move, node.pvLine, pnode.pvLine);
-        }
-
-        if (!node.use_aspiration
-            && node.expected_type == NodeType::ALL_NODE
-            && node.num_legal_move > 6) {
-            node.use_aspiration = true;
-        }
-        if (ply == 0)
-        {
-            std::cout << fmt::format("score={}\n", node.hash_move.score);
-        }
-    }
-
-    MoveList moveList;
-    size_t MLsize = 0;
-    if (node.type != NodeType::CUT_NODE)
-    {
-        TIME_IT(m_move_generation_timer);
-        generate_pseudo_moves(moveList, b);
-        UNTIL_THERE;
-        TIME_IT(m_move_ordering_timer);
-        reorder_moves(
-            *this, b, moveList, ply, remaining_depth,
-             m_killers, node.has_hash_move, node.hash_move, m_history
-        );
-        UNTIL_THERE;
-        MLsize = moveList.size();
+        bool gives_check = child_board->is_king_checked(other_color(clr));
+        ++node.num_legal_move;
 
-        for (auto &move : moveList)
+        int32_t val = 0;
+        // aspiration
+        if (node.use_aspiration && remaining_depth >= 2 && !gives_check)
         {
-            if (node.has_hash_move && move == node.hash_move) {
-                continue;
-            }
-            if (move.legal_checked && !move.legal) {
-                continue;
-            }
-
-            TIME_IT(m_make_move_timer);
-            b.make_move(move);
-            UNTIL_THERE;
-            ++node.num_move_maked;
-
-            move.legal_checked = true;
-            move.legal = !b.is_king_checked(clr);
-            if (!move.legal) {
-                // illegal move
-                move.score = std::numeric_limits<int32_t>::min();
-                TIME_IT2(m_unmake_move_timer);
-                b.unmake_move(move);
-                continue;
-            }
-            move.checks = b.is_king_checked(other_color(clr));
-            ++node.num_legal_move;
+            Node child;
+            child.expected_type = NodeType::CUT_NODE;
+            stats.num_aspiration_tries += 1;
 
-            int32_t val = 0;
-            // aspiration
-            if (node.use_aspiration && remaining_depth >= 2 && !move.checks)
+            int32_t r = compute_late_move_reductions(
+                node, remaining_depth, move, gives_check, order_score, picker.num_generated());
+            if (ply == 0)
             {
-                Node child;
-                child.expected_type = NodeType::CUT_NODE;
-                stats.num_aspiration_tries += 1;
-
-                int32_t r = compute_late_move_reductions(node, remaining_depth, move, MLsize);
-                if (ply == 0)
-                {
-                    send_currmove(max_depth, move, node.num_legal_move);
-                    std::cerr << fmt::format("depth={} move={} aspiration see={} r={}\n",
-                                           max_depth, move_to_string(move), move.see_value, r);
-                }
-                val = -negamax(
-                    node, child, b, max_depth, remaining_depth - 1 - r, ply + 1,
-                    -color, -alpha-1, -alpha, internal );
-
-                if (val > alpha && val < beta) {
-                    int32_t lower = -alpha - 1;
-                    int32_t initial_window_size = beta - alpha;
-
-                    int k = 0;
-                    while (val > alpha && val < beta && lower > -beta && k <= 3) {
-                        // while search window failed high we increment window
-                        stats.num_aspiration_failures += 1;
-                        double coeff = 1.0 / (8 >> k);
-                        if (k < 3) {
-                            stats.num_aspiration_tries += 1;
-                            lower = std::min(-alpha - (int32_t)(coeff * initial_window_size), lower-1);
-                        }
-                        else {
-                            lower = -beta;
-                        }
-                        // 1/8 , 1/4, 1/2, and eventually 1/1
-                        val = -negamax(
-                            node, child, b, max_depth, remaining_depth - 1, ply + 1,
-                            -color, lower, -alpha, internal );
-                        ++k;
-                    }
-                }
-                else {
-                    // nothing here ????
-                }
-                move.mate = child.type == NodeType::MATE;
-                move.pat = child.type == NodeType::PAT;
+                send_currmove(max_depth, move, node.num_legal_move);
+                fmt::print(stderr, "depth={} move={} aspiration order={} r={}\n",
+                           max_depth, move_to_uci_string(move), order_score, r);
             }
-            else {
-                int32_t r = compute_late_move_reductions(node, remaining_depth, move, MLsize);
-                //int32_t e = compute_move_extensions(node, max_depth, ply, remaining_depth, move, MLsize);
-                int32_t e = 0;
-                if (ply == 0)
-                {
-                    send_currmove(max_depth, move, node.num_legal_move + 1);
-                    std::cerr << fmt::format("depth={} move={} r={} e={} see={} \n",
-                                           max_depth, move_to_string(move), r,e, move.see_value);
-                }
-
-                Node child;
-                child.expected_type = expected_node_type(node, false);
-
-                val = -negamax(
-                    node, child, b, max_depth, remaining_depth - 1 - r + e, ply + 1,
-                    -color, -beta, -alpha, internal );
-                if (r > 0)
-                {
-                    // if a reduction is done ...
-                    if (val > alpha) {
-                        // ...and this is actually not a cut node
-                        // re-search at full depth
-                        val = -negamax(
-                            node, child, b, max_depth, remaining_depth - 1 + e, ply + 1,
-                            -color, -beta, -alpha, internal);
-                        if (r == 1) { ++stats.reduced_by_1_fail; }
-                        else if (r > 1) { ++stats.reduced_by_2_fail; }
+            val = -negamax(
+                node, child, *child_board, max_depth, remaining_depth - 1 - r, ply + 1,
+                -color, -alpha-1, -alpha, internal );
+
+            if (val > alpha && val < beta) {
+                int32_t lower = -alpha - 1;
+                int32_t initial_window_size = beta - alpha;
+
+                int k = 0;
+                while (val > alpha && val < beta && lower > -beta && k <= 3) {
+                    // while search window failed high we increment window
+                    stats.num_aspiration_failures += 1;
+                    double coeff = 1.0 / (8 >> k);
+                    if (k < 3) {
+                        stats.num_aspiration_tries += 1;
+                        lower = std::min(-alpha - (int32_t)(coeff * initial_window_size), lower-1);
                     }
                     else {
-                        if (r == 1) { ++stats.reduced_by_1; }
-                        else if (r > 1) { ++stats.reduced_by_2; }
+                        lower = -beta;
                     }
+                    // 1/8 , 1/4, 1/2, and eventually 1/1
+                    val = -negamax(
+                        node, child, *child_board, max_depth, remaining_depth - 1, ply + 1,
+                        -color, lower, -alpha, internal );
+                    ++k;
                 }
-                move.mate = child.type == NodeType::MATE;
-                move.pat = child.type == NodeType::PAT;
             }
-            move.score = val;
+            else {
+                // nothing here ????
+            }
+        }
+        else {
+            int32_t r = compute_late_move_reductions(
+                node, remaining_depth, move, gives_check, order_score, picker.num_generated());
+            //int32_t e = compute_move_extensions(node, max_depth, ply, remaining_depth, gives_check, MLsize);
+            int32_t e = 0;
             if (ply == 0)
             {
-                std::cout << fmt::format("score={}\n", move.score);
+                send_currmove(max_depth, move, node.num_legal_move + 1);
+                fmt::print(stderr, "depth={} move={} r={} e={} order={} \n",
+                           max_depth, move_to_uci_string(move), r,e, order_score);
             }
 
-            TIME_IT(m_unmake_move_timer)
-            b.unmake_move(move);
-            UNTIL_THERE;
+            Node child;
+            child.expected_type = expected_node_type(node, false);
 
-            if (m_stop_required) {
-                // INSTA-FAIL-HIGH
-                return std::max(node.score, beta);
+            val = -negamax(
+                node, child, *child_board, max_depth, remaining_depth - 1 - r + e, ply + 1,
+                -color, -beta, -alpha, internal );
+            if (r > 0)
+            {
+                // if a reduction is done ...
+                if (val > alpha) {
+                    // ...and this is actually not a cut node
+                    // re-search at full depth
+                    val = -negamax(
+                        node, child, *child_board, max_depth, remaining_depth - 1 + e, ply + 1,
+                        -color, -beta, -alpha, internal);
+                    if (r == 1) { ++stats.reduced_by_1_fail; }
+                    else if (r > 1) { ++stats.reduced_by_2_fail; }
+                }
+                else {
+                    if (r == 1) { ++stats.reduced_by_1; }
+                    else if (r > 1) { ++stats.reduced_by_2; }
+                }
             }
+        }
+        if (ply == 0)
+        {
+            fmt::print(stdout, "score={}\n", val);
+        }
 
-            if (val > node.score) {
-                node.score = val;
-                node.best_move = move;
-                node.found_best_move = true;
-            }
-            if (val >= beta) {
-                node.type = NodeType::CUT_NODE;
-                if (move.mate_killer) { stats.num_cut_by_mate_killer += 1; }
-                else if (move.killer) { stats.num_cut_by_killer += 1; }
-                update_cut_heuristics(move, node, ply);
-                break;
-            }
-            if (val > alpha) {
-                alpha = val;
-                node.type = NodeType::PV_NODE;
-                node.use_aspiration = true;
-                extract_pv(move, node.pvLine, pnode.pvLine);
-            }
+        TIME_IT(m_unmake_move_timer)
+        unmake_search_move(b, move);
+        UNTIL_THERE;
+
+        if (m_stop_required) {
+            // INSTA-FAIL-HIGH
+            return std::max(node.score, beta);
+        }
+
+        if (val > node.score) {
+            node.score = val;
+            node.best_move = move;
+            node.found_best_move = true;
+        }
+        if (val >= beta) {
+            node.type = NodeType::CUT_NODE;
+            if (order_score == HASH_MOVE_SCORE) { stats.num_cut_by_hash_move += 1; }
+            else if (order_score == MATE_KILLER_SCORE) { stats.num_cut_by_mate_killer += 1; }
+            else if (order_score == KILLER_SCORE) { stats.num_cut_by_killer += 1; }
+            update_cut_heuristics(b, move, val, ply);
+            break;
+        }
+        if (val > alpha) {
+            alpha = val;
+            node.type = NodeType::PV_NODE;
+            node.use_aspiration = true;
+            extract_pv(move, node.pvLine, pnode.pvLine);
         }
     }
-    stats.num_move_skipped += (uint32_t)std::max(MLsize, 1_u64) - node.num_move_maked;
-    stats.num_move_generated += (uint32_t)MLsize;
+    size_t num_generated = picker.num_generated();
+    stats.num_move_skipped += (uint32_t)(num_generated - std::min<size_t>(num_generated, node.num_move_maked));
+    stats.num_move_generated += (uint32_t)num_generated;
     stats.num_move_maked += node.num_move_maked;
     stats.num_nodes += 1;
     stats.num_match_expected += (int)(node.type == node.expected_type);
@@ -838,58 +766,48 @@ void NegamaxEngine::stop()
     m_running = false;
 }
 
-void NegamaxEngine::extract_pv_from_tt(Board& b, MoveList& pv, int depth, int ply)
+void NegamaxEngine::extract_pv_from_tt(Board& b, PvLine& pv, int depth, int ply)
 {
     // extract PV  from TT
     // std::cout << "extract PV from TT\n" << std::flush;
 
-    pv.reserve(depth);
-    while (depth > 0)
+    size_t first = pv.size();
+    while (depth > 0 && ply < (int)MAX_PLY && pv.size() < MAX_PLY)
     {
         uint64_t bkey = b.get_key();
-        auto& hashentry = m_hash.get(bkey);
-        if (hashentry.key == 0) {
-            //std::cerr << "did not found entry for pv move in TT == 0\n";
+        HashEntry hashentry;
+        HashSlot* slot;
+        if (!m_hash.probe(bkey, hashentry, slot)) {
+            //std::cerr << "did not found entry for pv move in TT\n";
             break;
         }
-        if (hashentry.key != bkey) {
-            //std::cerr << "did not found entry for pv move in TT => KEY CONFLICT\n";
-            break;
-        }
-        if (!is_exact_score(hashentry.node_type)) {
+        if (!is_exact_score(hashentry.node_type())) {
             //std::cerr << "entry in TT is not exact score\n";
             break;
         }
-        bool has_hash_move = hashentry.hashmove_src != hashentry.hashmove_dst;
+        Move hash_move{ hashentry.hash_move };
+        bool has_hash_move = !hash_move.is_none();
         if (!has_hash_move) {
             // std::cerr << "no hashmove in TT for PV-node\n";
             break;
         }
-        Move hash_move;
-        has_hash_move = generate_move_for_squares(
-            b,
-            hashentry.hashmove_src,
-            hashentry.hashmove_dst,
-            hashentry.promote_piece,
-            hash_move
-        );
+        has_hash_move = b.is_pseudo_legal(hash_move) && b.is_legal(hash_move);
         if (!has_hash_move) {
             // std::cerr << "no hashmove in TT for PV-node\n";
             break;
         }
         b.make_move(hash_move);
 
-        hash_move.checks = b.is_king_checked(other_color(hash_move.color));
-        hash_move.mate = hashentry.score == 20000 - (ply+1);
+        bool mate = hashentry.score == 20000 - (ply+1);
         pv.push_back(hash_move);
         --depth;
         ++ply;
-        if (hash_move.mate)
+        if (mate)
         {
             break;
         }
     }
-    for (auto i = pv.size(); i > 0; --i) {
+    for (auto i = pv.size(); i > first; --i) {
         b.unmake_move(pv[i - 1]);
     }
 }
@@ -913,9 +831,9 @@ int32_t compute_mate_score(int32_t score, int32_t depth)
 }
 
 
-void send_score(int32_t score, int32_t mate, int32_t depth,
-                int32_t total_nodes, int32_t nps, double duration,
-                const MoveList &pvLine)
+void send_score(int32_t score, int32_t mate, int32_t depth, uint32_t seldepth,
+                uint64_t total_nodes, uint64_t nps, uint32_t hashfull, uint64_t duration,
+                const PvLine &pvLine)
 {
     std::vector<std::string> moves_str;
     moves_str.reserve(pvLine.size());
@@ -924,18 +842,36 @@ void send_score(int32_t score, int32_t mate, int32_t depth,
     }
     if (mate != 0) {
         uci_send(
-            "info depth {} score mate {} nodes {} nps {} pv {} time {}\n",
-            depth, mate, total_nodes, nps, fmt::join(moves_str, " "), duration
+            "info depth {} seldepth {} score mate {} nodes {} nps {} hashfull {} pv {} time {}\n",
+            depth, seldepth, mate, total_nodes, nps, hashfull, fmt::join(moves_str, " "), duration
         );
     }
     else {
         uci_send(
-            "info depth {} score cp {} nodes {} nps {} pv {} time {}\n",
-            depth, score, total_nodes, nps, fmt::join(moves_str, " "), duration
+            "info depth {} seldepth {} score cp {} nodes {} nps {} hashfull {} pv {} time {}\n",
+            depth, seldepth, score, total_nodes, nps, hashfull, fmt::join(moves_str, " "), duration
         );
     }
 }
 
+/**
+ * progress of a long iteration, at most once per second
+ */
+void NegamaxEngine::send_periodic_info(int depth)
+{
+    uint64_t elapsed_ms = (uint64_t)(m_search_timer.get_micro_length() / 1000);
+    if (elapsed_ms < m_next_info_ms) {
+        return;
+    }
+    m_next_info_ms = elapsed_ms + 1000;
+    uint64_t nodes = m_search_nodes + m_regular_nodes + m_quiescence_nodes;
+    uci_send(
+        "info depth {} seldepth {} nodes {} nps {} hashfull {} time {}\n",
+        depth, m_seldepth, nodes, nodes * 1000 / std::max(elapsed_ms, 1_u64),
+        m_hash.hashfull(), elapsed_ms
+    );
+}
+
 /**
  * return  true if search was interrupted by m_stop_required,
  * and false otherwise
@@ -951,11 +887,17 @@ bool NegamaxEngine::iterative_deepening(
 
     int color = b.get_next_move() == C_WHITE ? +1 : -1;
 
+    max_depth = std::min(max_depth, (int)MAX_PLY - 1);
     this->set_max_depth(max_depth);
-    Timer total_timer;
-    total_timer.start();
+    m_hash.new_search();
+    // search and pv extraction may go this deep without growing the undo stack
+    b.reserve_plies(2 * MAX_PLY);
+    m_search_timer.reset();
+    m_search_timer.start();
+    m_next_info_ms = 1000;
     m_total_nodes_prev = 0;
     m_total_nodes_prev_prev = 0;
+    m_search_nodes = 0;
 
     for (int depth = 1; depth <= max_depth; ++depth) {
         Timer t;
@@ -965,19 +907,26 @@ bool NegamaxEngine::iterative_deepening(
         m_regular_nodes = 0;
         m_leaf_nodes = 0;
         m_quiescence_nodes = 0;
+        m_seldepth = 0;
         Node rootparent, root;
-        MoveList& pvLine = rootparent.pvLine;
+        PvLine& pvLine = rootparent.pvLine;
         root.expected_type = NodeType::PV_NODE;
 
+        if (m_audit_allocations) {
+            AllocAudit::begin();
+        }
         int32_t score = this->negamax(
             rootparent, root, b, depth, depth, 0, color,
             -999999, // alpha
             +999999, // beta
             false
         );
+        if (m_audit_allocations) {
+            m_audited_allocations += AllocAudit::end();
+        }
 
         if (m_stop_required_by_timeout || max_time_ms > 0) {
-            uint64_t total_duration = (uint64_t)(total_timer.get_micro_length() / 1000.0);
+            uint64_t total_duration = (uint64_t)(m_search_timer.get_micro_length() / 1000.0);
             if (total_duration > max_time_ms) {
                 uci_send_info_string(
                     "EXIT ON TIME total_duration={} max_time_ms={} move_found={}",
@@ -1009,13 +958,15 @@ bool NegamaxEngine::iterative_deepening(
 
         display_readable_pv(b, pvLine, score);
 
-        uint64_t total_nodes = m_regular_nodes + m_quiescence_nodes;
-        double duration = std::max(t.get_length(), 0.001); // cap at 1ms
-        uint64_t nps = (uint64_t)(total_nodes / duration);
-        uint64_t duration_msec = (uint64_t)(t.get_micro_length() / 1000);
+        m_search_nodes += m_regular_nodes + m_quiescence_nodes;
+        // nodes and time of the whole search so far, as uci expects
+        double duration = std::max(m_search_timer.get_length(), 0.001); // cap at 1ms
+        uint64_t nps = (uint64_t)(m_search_nodes / duration);
+        uint64_t duration_msec = (uint64_t)(duration * 1000);
 
         int32_t mate = compute_mate_score(score, depth);
-        send_score(score, mate, depth, total_nodes, nps, duration_msec, pvLine);
+        send_score(score, mate, depth, m_seldepth, m_search_nodes, nps,
+                   m_hash.hashfull(), duration_msec, pvLine);
 
         //display_stats(depth);
         //display_timers(t);
@@ -1049,96 +1000,50 @@ std::pair<bool,Move> find_best_move(Board& b)
 uint64_t NegamaxEngine::perft(
     Board &b,
     uint32_t max_depth, uint32_t remaining_depth,
-    std::vector<uint64_t> &res, Hash<PerftHashEntry> &hash)
+    std::vector<uint64_t> &res)
 {
     if (remaining_depth == 0) {
         return 1;
     }
     auto ply = max_depth - remaining_depth;
 
-    //auto key = b.get_key();
-    //uint64_t full_key = HashMethods::full_hash(b);
-    //if (key != full_key) {
-    //    std::abort();
-    //}
-    //if (remaining_depth >= 1)
-    //{
-    //    auto& hashentry = hash.get(key);
-    //    if (hashentry.key == key && hashentry.depth == remaining_depth)
-    //    {
-    //        res[ply] += hashentry.nummoves;
-    //        return hashentry.value;
-    //    }
-    //}
-    Color clr = b.get_next_move();
-
     MoveList ml;
-    //if (b.is_king_checked(clr))
-    //{
-    //    ml = generate_check_evading_moves(b);
-    //}
-    //else
-    //{
-        generate_pseudo_moves(ml, b);
-    //}
+    generate_legal_moves(ml, b);
 
+    if (remaining_depth == 1 && max_depth > 1) {
+        // bulk count, no need to play the leaves
+        res[ply] += ml.size();
+        return ml.size();
+    }
 
     uint64_t total = 0;
     int num_legal_move = 0;
-    for (auto &move : ml)
+    for (Move move : ml)
     {
-        //if (move.legal_checked && !move.legal) {
-        //    continue;
-        //}
-        b.make_move(move);
-
-        if (b.is_king_checked(clr))
-        {
-            b.unmake_move(move);
-
-            continue;
-        }
+        Board& child_board = make_search_move(b, move, max_depth - remaining_depth);
         ++num_legal_move;
-        uint64_t val = perft(b, max_depth, remaining_depth-1, res, hash);
+        uint64_t val = perft(child_board, max_depth, remaining_depth-1, res);
 
         total += val;
-        b.unmake_move(move);
+        unmake_search_move(b, move);
 
         if (max_depth == remaining_depth)
         {
-            std::cout << move_to_uci_string(move) <<": "<<val<< " "<<move_to_string(move) << "\n";
+            std::cout << move_to_uci_string(move) <<": "<<val<< " "<<move_to_string(b, move) << "\n";
         }
     }
 
     res[ply] += num_legal_move;
-    //if (remaining_depth>=1 ) {
-    //    auto& hashentry = hash.get(key);
-    //    if (remaining_depth > hashentry.depth)
-    //    {
-    //        // save only position with most savings potential
-    //        hashentry.key = key;
-    //        hashentry.depth = remaining_depth;
-    //        hashentry.value = total;
-    //        hashentry.nummoves = num_legal_move;
-    //    }
-
-    //}
     return total;
 }
 
 void NegamaxEngine::set_max_depth(int maxdepth)
 {
     m_max_depth = maxdepth;
-    m_killers.clear();
-    m_killers.resize(maxdepth);
-
-    m_stats.clear();
-    for (int depth = 1; depth <= maxdepth; ++depth) {
-        for (int curdepth = 0; curdepth < depth; ++curdepth)
-        {
-            m_stats[depth][curdepth] = Stats{};
-        }
+    for (auto& killers : m_killers) {
+        killers.fill(Killer{ Move{}, false });
     }
+    m_stats.assign((maxdepth + 1) * MAX_PLY, Stats{});
 }
 
 std::string human_readable(double value)
@@ -1160,13 +1065,12 @@ std::string human_readable(double value)
 
 void NegamaxEngine::do_perft(Board &b, uint32_t depth)
 {
-    Hash<PerftHashEntry> hash;
     std::vector<uint64_t> res;
     res.resize(depth);
     std::fill(res.begin(), res.end(), 0);
     Timer t;
     t.start();
-    uint64_t total = perft(b, depth, depth, res, hash);
+    uint64_t total = perft(b, depth, depth, res);
     t.stop();
     double duration = t.get_length();
     std::cout << "total=" << total << "\n";
@@ -1189,21 +1093,134 @@ void NegamaxEngine::do_perft(Board &b, uint32_t depth)
     }
 }
 
+void NegamaxEngine::init_hash()
+{
+    m_hash.init(m_hash_size_mb);
+    uci_send_info_string("hash: {}", m_hash.memory_description());
+}
+
+/* on failure the previous table and size are kept */
+void NegamaxEngine::set_hash_size(size_t size_mb)
+{
+    m_hash.init(size_mb);
+    m_hash_size_mb = m_hash.size_in_bytes() >> 20;
+    uci_send_info_string("hash: {}", m_hash.memory_description());
+}
+
+/**
+ * fixed depth search of all test positions, used to compare
+ * speed between builds and hosts
+ */
+void NegamaxEngine::do_bench(uint32_t depth)
+{
+    uci_send_info_string("slider attacks: {}", slider_backend_description());
+
+    uint64_t total_nodes = 0;
+    Timer t; // searches only, clearing a big table is not part of it
+    for (int position = 1; position <= 8; ++position) {
+        Board b;
+        load_test_position(b, position);
+        clear_hash();
+
+        Move best_move;
+        bool move_found = false;
+        t.start();
+        iterative_deepening(b, depth, &best_move, &move_found, 0);
+        t.stop();
+        total_nodes += m_search_nodes;
+    }
+
+    double duration = std::max(t.get_length(), 0.001);
+    uci_send_info_string(
+        "bench depth {} nodes {} time {} nps {}",
+        depth, total_nodes, (uint64_t)(duration * 1000),
+        (uint64_t)(total_nodes / duration)
+    );
+}
+
+/**
+ * search each test position twice at fixed depth, the first time
+ * to warm up, and fail if the second one allocates on the heap
+ */
+void NegamaxEngine::do_alloc_audit(uint32_t depth)
+{
+    if (!AllocAudit::enabled()) {
+        uci_send_info_string("allocation audit unavailable, build with CHESS_ALLOC_AUDIT");
+        return;
+    }
+
+    for (int position = 1; position <= 8; ++position) {
+        Board b;
+        load_test_position(b, position);
+        Move best_move;
+        bool move_found = false;
+
+        clear_hash();
+        iterative_deepening(b, depth, &best_move, &move_found, 0);
+
+        clear_hash();
+        m_audit_allocations = true;
+        m_audited_allocations = 0;
+        iterative_deepening(b, depth, &best_move, &move_found, 0);
+        m_audit_allocations = false;
+
+        if (m_audited_allocations > 0) {
+            throw chess_exception(fmt::format(
+                "{} heap allocations while searching test position {} at depth {}",
+                m_audited_allocations, position, depth
+            ));
+        }
+    }
+    uci_send_info_string("allocation audit depth {}: no heap allocation in search", depth);
+}
 
 // --------------------------------------------------------
 // --- STATS AND REPORTS ----------------------------------
 
 void NegamaxEngine::display_stats()
 {
-    for (auto& [maxdepth, stats_at_depth] : m_stats) {
+    for (uint32_t maxdepth = 1; maxdepth <= m_max_depth; ++maxdepth) {
         display_stats(maxdepth);
     }
 }
 
+void NegamaxEngine::display_hash_stats()
+{
+    std::cerr << fmt::format(
+        "hash {} MB generation {}\n{:>4} {:>10} {:>6} {:>10} {:>10} {:>10}\n",
+        m_hash.size_in_bytes() >> 20, m_hash.generation(),
+        "ply", "probes", "hit%", "stores", "overwrite%", "stale%");
+    for (int ply = 0; ply < (int)MAX_PLY; ++ply) {
+        Stats total;
+        for (uint32_t maxdepth = 1; maxdepth <= m_max_depth; ++maxdepth) {
+            const Stats& stats = stats_at(maxdepth, ply);
+            total.num_hash_probes += stats.num_hash_probes;
+            total.num_hash_hits += stats.num_hash_hits;
+            total.num_hash_stores += stats.num_hash_stores;
+            total.num_hash_overwrites += stats.num_hash_overwrites;
+            total.num_hash_stale_overwrites += stats.num_hash_stale_overwrites;
+        }
+        if (total.num_hash_probes == 0) {
+            continue;
+        }
+        double probes = total.num_hash_probes;
+        double stores = std::max(total.num_hash_stores, u32(1));
+        std::cerr << fmt::format(
+            "{:>4} {:>10} {:>6.1f} {:>10} {:>10.1f} {:>10.1f}\n",
+            ply, total.num_hash_probes, 100.0 * total.num_hash_hits / probes,
+            total.num_hash_stores, 100.0 * total.num_hash_overwrites / stores,
+            100.0 * total.num_hash_stale_overwrites / stores);
+    }
+}
+
 void NegamaxEngine::display_stats(int current_maxdepth)
 {
     std::cerr << "stats for current_maxdepth=" << current_maxdepth << "\n";
-    for (auto& [depth, stats] : m_stats[current_maxdepth]) {
+    for (int depth = 0; depth < (int)MAX_PLY; ++depth) {
+        const Stats& stats = stats_at(current_maxdepth, depth);
+        if (depth >= current_maxdepth && stats.num_nodes == 0) {
+            continue;
+        }
 
         double percent_maked = (double)stats.num_move_maked / std::max(stats.num_move_generated, u32(1));
         double percent_skipped = (double)stats.num_move_skipped / std::max(stats.num_move_generated, u32(1));
@@ -1235,8 +1252,12 @@ void NegamaxEngine::display_stats(int current_maxdepth)
             << " (" << (int)(percent_maked * 100.0) << "%) "
             << " skipped=" << stats.num_move_skipped
             << " (" << (int)(percent_skipped * 100.0) << "%) "
-            << "\n   HASH hits=" << stats.num_hash_hits
+            << "\n   HASH probes=" << stats.num_hash_probes
+            << " hits=" << stats.num_hash_hits
             << " conflicts=" << stats.num_hash_conflicts
+            << " stores=" << stats.num_hash_stores
+            << " overwrites=" << stats.num_hash_overwrites
+            << " stale=" << stats.num_hash_stale_overwrites
             << "\n   ASPIRATION total=" << stats.num_aspiration_tries
             << " failure=" << stats.num_aspiration_failures
             << " success=" << stats.num_aspiration_tries-stats.num_aspiration_failures
@@ -1317,13 +1338,13 @@ void NegamaxEngine::display_node_infos(Timer &t)
     std::cerr << "\n-----------------\n\n";
 
 }
-void NegamaxEngine::display_readable_pv(Board &b, const MoveList &pvLine, int32_t score)
+void NegamaxEngine::display_readable_pv(Board &b, const PvLine &pvLine, int32_t score)
 {
     std::vector<std::string> moves_str;
     moves_str.reserve(pvLine.size());
-    for (const auto& m : pvLine) {
-        moves_str.emplace_back(move_to_string_disambiguate(b, m));
-        b.make_move(m);
+    for (size_t i = 0; i < pvLine.size(); ++i) {
+        moves_str.emplace_back(move_to_string_disambiguate(b, pvLine[i]));
+        b.make_move(pvLine[i]);
 
     }
     for (auto i = pvLine.size(); i > 0; --i)
@@ -1,8 +1,8 @@
 #ifndef CHESS_ENGINE_H
 #define CHESS_ENGINE_H
 
-#include <map>
-#include <unordered_map>
+#include <array>
+#include <vector>
 #include <algorithm>
 #include <thread>
 
@@ -13,6 +13,10 @@
 #include "./uci.hpp"
 
 
+enum EngineValues {
+    DEFAULT_HASH_MB = 16,
+};
+
 struct Node {
     NodeType type;
     NodeType expected_type;
@@ -28,7 +32,7 @@ struct Node {
     bool in_check;
     Move hash_move;
     Move best_move;
-    MoveList pvLine;
+    PvLine pvLine;
 
     Node() :
         type{ NodeType::UNDEFINED },
@@ -67,8 +71,12 @@ struct Stats {
     uint32_t num_move_maked;//including illegal moves
     uint32_t num_move_skipped;
     uint32_t num_move_generated;
+    uint32_t num_hash_probes;
     uint32_t num_hash_hits;
     uint32_t num_hash_conflicts;
+    uint32_t num_hash_stores;
+    uint32_t num_hash_overwrites; // another position evicted
+    uint32_t num_hash_stale_overwrites; // evicted entry was from a previous search
 
     uint32_t num_aspiration_tries;
     uint32_t num_aspiration_failures;
@@ -92,8 +100,12 @@ struct Stats {
         num_move_maked{0},
         num_move_skipped{ 0 },
         num_move_generated{ 0 },
+        num_hash_probes{ 0 },
         num_hash_hits{ 0 },
         num_hash_conflicts{ 0 },
+        num_hash_stores{ 0 },
+        num_hash_overwrites{ 0 },
+        num_hash_stale_overwrites{ 0 },
         num_aspiration_tries{ 0 },
         num_aspiration_failures{ 0 }
     {
@@ -105,12 +117,14 @@ struct NegamaxEngine
 private:
     KillerMoves m_killers;
     HistoryMoves m_history;
+    CounterMoves m_counter_moves;
+    std::array<Move, MAX_PLY> m_move_stack; // move played at each ply
     uint32_t m_max_depth;
     uint32_t m_current_max_depth; // iterative deepening;
 
 
-    //  current_max_depth, current_depth
-    std::map<uint32_t, std::map<uint32_t, Stats>> m_stats;
+    // indexed by current_max_depth * MAX_PLY + current_depth
+    std::vector<Stats> m_stats;
 
     Timer m_move_ordering_timer;
     Timer m_move_ordering_mvv_lva_timer;
@@ -129,6 +143,10 @@ private:
     uint64_t m_regular_nodes;
     uint64_t m_leaf_nodes;
     uint64_t m_quiescence_nodes;
+    uint64_t m_search_nodes; // all completed iterations of last search
+    uint32_t m_seldepth; // deepest ply reached in the current iteration, quiescence included
+    Timer m_search_timer; // since the start of the current search
+    uint64_t m_next_info_ms; // when to send the next periodic info line
     bool m_has_current_root_evaluation;
     int32_t m_current_root_evaluation;
 
@@ -140,22 +158,64 @@ private:
     bool m_stop_required_by_timeout;
     bool m_running;
 
-    std::vector<uint64_t> m_positions_sequence;//store Zkey
+    std::array<uint64_t, MAX_PLY> m_positions_sequence;//store Zkey
+#ifdef CHESS_COPY_MAKE
+    std::vector<Board> m_board_stack; // board reached at each ply
+#endif
+    bool m_audit_allocations;
+    uint64_t m_audited_allocations;
+    size_t m_hash_size_mb; // UCI "Hash" option
 
 
     void _start_uci_background(Board& b);
     void reset_timers();
+    void send_periodic_info(int depth);
 
-    void extract_pv_from_tt(Board& b, MoveList& pv, int depth, int ply);
+    Stats& stats_at(int max_depth, int ply) { return m_stats[max_depth * MAX_PLY + ply]; }
+    void extract_pv_from_tt(Board& b, PvLine& pv, int depth, int ply);
     void handle_no_move_available(Board &b);
 
     bool lookup_hash(Board &b, Node &node, Stats& stats,
         int32_t remaining_depth, int32_t ply,
         int32_t alpha, int32_t beta,
         Node &parent_node);
-    void update_cut_heuristics(Move& move, Node& node, int32_t ply);
+    void update_cut_heuristics(Board& b, Move move, int32_t score, int32_t ply);
+    /* quiet move that last refuted `prev`, none if unknown */
+    Move counter_move(const Board& b, Move prev) const {
+        if (prev.is_none()) {
+            return Move{};
+        }
+        Color prev_clr = other_color(b.get_next_move());
+        return m_counter_moves[prev_clr * 64 * 64 + prev.src_sq() * 64 + prev.dst_sq()];
+    }
     void update_hash(Node &node, Stats& stats, int remaining_depth);
 
+    /**
+     * play `move` on `b` (make/unmake) or on a copy of `b` in the slot
+     * of ply + 1 (CHESS_COPY_MAKE), the search goes on with the result
+     */
+    Board& make_search_move(Board& b, Move move, size_t ply) {
+#ifdef CHESS_COPY_MAKE
+        Board& child = m_board_stack[ply + 1];
+        child.copy_position(b);
+        child.apply_move(move);
+        return child;
+#else
+        (void)ply;
+        b.make_move(move);
+        return b;
+#endif
+    }
+    /* `b` is the parent board given to make_search_move */
+    void unmake_search_move(Board& b, Move move) {
+#ifdef CHESS_COPY_MAKE
+        (void)b;
+        (void)move;
+#else
+        b.unmake_move(move);
+#endif
+    }
+
 public:
     NegamaxEngine():
         m_max_depth{ 0 },
@@ -165,22 +225,45 @@ public:
         m_regular_nodes{ 0 },
         m_leaf_nodes{ 0 },
         m_quiescence_nodes{ 0 },
+        m_search_nodes{ 0 },
+        m_seldepth{ 0 },
+        m_next_info_ms{ 0 },
         m_has_current_root_evaluation{ false },
         m_current_root_evaluation{0},
         m_run_id{ 0 },
         m_uci_mode{ false },
         m_stop_required{ false },
         m_stop_required_by_timeout{ false },
-        m_running{ false }
+        m_running{ false },
+        m_audit_allocations{ false },
+        m_audited_allocations{ 0 },
+        m_hash_size_mb{ DEFAULT_HASH_MB }
     {
         m_history.resize( 2 * 64 * 64);
         std::cout  <<"m_history size() == "<<m_history.size() <<"\n";
         std::fill(m_history.begin(), m_history.end(), 0);
+        m_counter_moves.fill(Move{});
+        m_move_stack.fill(Move{});
+#ifdef CHESS_COPY_MAKE
+        m_board_stack.assign(MAX_PLY + 1, Board(0));
+        for (auto& slot : m_board_stack) {
+            // pv extraction still makes/unmakes moves on these boards
+            slot.reserve_plies(MAX_PLY);
+        }
+#endif
+        init_hash();
     }
-    Hash<HashEntry> m_hash;
+    TranspositionTable m_hash;
 
-    void init_hash() { m_hash.init(1000); }
-    void clear_hash() { m_hash.clear(); init_hash(); }
+    void init_hash();
+    /* replace the table by a saved one, the Hash size follows it */
+    void load_hash(const std::string& path) {
+        m_hash.load(path);
+        m_hash_size_mb = m_hash.size_in_bytes() >> 20;
+    }
+    void clear_hash() { m_hash.clear(); }
+    /* reallocate the table, must not be called while searching */
+    void set_hash_size(size_t size_mb);
 
     void stop();
     bool is_running() const { return m_running; }
@@ -194,8 +277,10 @@ public:
     void display_timers(Timer&);
     void display_stats();
     void display_stats(int current_maxdepth);
+    /* transposition table use per ply over all iterations of the last search */
+    void display_hash_stats();
     void display_node_infos(Timer&);
-    void display_readable_pv(Board& b, const MoveList& pvLine, int32_t score);
+    void display_readable_pv(Board& b, const PvLine& pvLine, int32_t score);
 
     int32_t quiesce(Node &node, Board& b, int color, int32_t alpha, int32_t beta, uint32_t ply, uint32_t qply);
     int32_t negamax(
@@ -214,8 +299,10 @@ public:
     void set_max_depth(int maxdepth);
     void set_current_maxdepth(int maxdepth) { m_current_max_depth = maxdepth; }
     uint64_t perft(Board &b, uint32_t max_depth, uint32_t remaining_depth,
-        std::vector<uint64_t> &res, Hash<PerftHashEntry>&);
+        std::vector<uint64_t> &res);
     void do_perft(Board &b, uint32_t depth);
+    void do_bench(uint32_t depth);
+    void do_alloc_audit(uint32_t depth);
 };
 
 
@@ -9,8 +9,10 @@ int32_t evaluate_board(const Board& b)
     int32_t material = 0;
     int32_t pawn_position = 0;
 
-    for (uint8_t i = 0; i < 64; ++i) {
-        Pos pos{ i };
+    // empty squares do not contribute, only visit occupied ones
+    Bitboard occupied = b.get_occupied();
+    while (occupied) {
+        Pos pos{ pop_lsb(occupied) };
 
         Color c = b.get_color_at(pos);
         Piece p = b.get_piece_at(pos);
@@ -5,6 +5,7 @@
 #include "./board_renderer.hpp"
 #include "./uci.hpp"
 #include "./transposition_table.hpp"
+#include "./attacks.hpp"
 
 using namespace std;
 
@@ -13,7 +14,7 @@ using namespace std;
 int main(int argc, char *argv[])
 {
     std::cout << "Tistou Chess by Thomas Mijieux\n"<<std::flush;
-    HashParams::init_params();
+    AttackTables::init_tables();
     try {
         uci_main_loop();
     }
@@ -3,140 +3,217 @@
 
 struct Move;
 
+#include <array>
 #include <vector>
+#include <algorithm>
+
 #include "./types.hpp"
 #include "./board.hpp"
 
-struct NullMove
+enum MoveFlag : uint8_t {
+    MF_NORMAL = 0,
+    MF_PROMOTE = 1,
+    MF_EN_PASSANT = 2,
+    MF_CASTLING = 3,
+};
+
+/**
+ * move packed in 16 bits:
+ *   bits  0-5  source square
+ *   bits  6-11 destination square
+ *   bits 12-13 promotion piece (P_BISHOP..P_QUEEN, minus P_BISHOP)
+ *   bits 14-15 MoveFlag
+ * moving piece, color and captured piece are read from the board
+ * the move is played on. The all zero move (a1a1) is the null/none move.
+ */
+struct Move
 {
 public:
-    uint32_t m_board_state_before;
-    uint64_t m_board_key_before;
-    uint8_t half_move_before;
+    uint16_t data;
 
-    NullMove(const Board& b)
+    constexpr Move() : data{ 0 } {}
+    constexpr explicit Move(uint16_t d) : data{ d } {}
+    constexpr Move(uint8_t src, uint8_t dst, MoveFlag flag = MF_NORMAL, Piece promote_piece = P_BISHOP) :
+        data((uint16_t)(src | (dst << 6) | ((promote_piece - P_BISHOP) << 12) | (flag << 14)))
     {
-        m_board_state_before = b.get_flags();
-        m_board_key_before = b.get_key();
-        half_move_before = b.get_half_move();
     }
-};
 
-struct Move
+    constexpr uint8_t src_sq() const { return data & 0x3F; }
+    constexpr uint8_t dst_sq() const { return (data >> 6) & 0x3F; }
+    Pos src() const { return Pos{ src_sq() }; }
+    Pos dst() const { return Pos{ dst_sq() }; }
+
+    constexpr MoveFlag flag() const { return (MoveFlag)(data >> 14); }
+    constexpr bool is_promote() const { return flag() == MF_PROMOTE; }
+    constexpr bool is_en_passant() const { return flag() == MF_EN_PASSANT; }
+    constexpr bool is_castling() const { return flag() == MF_CASTLING; }
+    constexpr Piece promote_piece() const {
+        return is_promote() ? (Piece)(P_BISHOP + ((data >> 12) & 0x3)) : P_EMPTY;
+    }
+    constexpr bool is_none() const { return data == 0; }
+
+    constexpr bool operator==(const Move& o) const { return data == o.data; }
+    constexpr bool operator!=(const Move& o) const { return data != o.data; }
+}; // class Move
+
+static_assert(sizeof(Move) == 2, "Move must stay packed in 16 bits");
+
+// deepest ply the search may reach, sizes all per-ply buffers
+constexpr size_t MAX_PLY = 128;
+// capacity of a move list, more than the pseudo-moves of any position
+constexpr size_t MAX_MOVES = 256;
+constexpr size_t NUM_KILLERS = 3;
+
+/**
+ * moves with their ordering score kept in a parallel array,
+ * so that the moves themselves stay small.
+ * fixed capacity storage, lives on the stack and never allocates
+ */
+class MoveList
 {
+private:
+    std::array<Move, MAX_MOVES> m_moves;
+    std::array<int32_t, MAX_MOVES> m_scores;
+    size_t m_size;
+
 public:
-    int32_t score;
-    int32_t see_value;
-    int32_t mvv_lva_value;
-
-    Pos src;
-    Pos dst;
-
-    Color color;
-    Piece piece;
-    Piece taken_piece;
-    Piece promote_piece;
-
-    unsigned en_passant : 1;
-    unsigned killer : 1;
-    unsigned mate_killer : 1;
-    unsigned hash_move : 1;
-    unsigned takes : 1;
-    unsigned castling : 1;
-    unsigned legal : 1;
-    unsigned legal_checked : 1;
-    unsigned promote : 1;
-    unsigned checks : 1;
-    unsigned mate : 1;
-    unsigned pat : 1;
-
-    // remember some of state of board before move
-    uint32_t m_board_state_before;
-    uint64_t m_board_key_before;
-    uint8_t half_move_before;
-
-    Move():
-        score{-999999},
-        see_value{ 0 },
-        mvv_lva_value{ 0 },
-        color{C_BLACK},
-        piece{P_INVALID_PIECE},
-        taken_piece{P_EMPTY},
-        promote_piece{ P_EMPTY },
-        en_passant{false},
-        killer{false},
-        mate_killer{false},
-        hash_move{false},
-        takes{false},
-        castling{false},
-        legal{false},
-        legal_checked{false},
-        promote{ false },
-        checks{ false },
-        mate{false},
-        pat{false},
-        m_board_state_before{ 0 },
-        m_board_key_before{ 0 },
-        half_move_before{0}
+    using iterator = Move*;
+    using const_iterator = const Move*;
+
+    MoveList() : m_size{ 0 } {}
+    MoveList(const MoveList& o) : m_size{ o.m_size }
     {
+        std::copy(o.m_moves.begin(), o.m_moves.begin() + m_size, m_moves.begin());
+        std::copy(o.m_scores.begin(), o.m_scores.begin() + m_size, m_scores.begin());
     }
-
-    Move(const Board& b) : Move()
+    MoveList& operator=(const MoveList& o)
     {
-        m_board_state_before = b.get_flags();
-        m_board_key_before = b.get_key();
-        half_move_before = b.get_half_move();
+        m_size = o.m_size;
+        std::copy(o.m_moves.begin(), o.m_moves.begin() + m_size, m_moves.begin());
+        std::copy(o.m_scores.begin(), o.m_scores.begin() + m_size, m_scores.begin());
+        return *this;
     }
 
-    inline bool operator==(const Move& o)
+    void push_back(Move m)
     {
-        return dst == o.dst
-            && src ==o.src
-            && piece == o.piece
-            && promote == o.promote
-            && promote_piece == o.promote_piece;
+#ifdef CHESS_DEBUG
+        if (m_size >= MAX_MOVES) {
+            throw chess_exception("move list overflow");
+        }
+#endif
+        m_moves[m_size] = m;
+        m_scores[m_size] = 0;
+        ++m_size;
+    }
+    void clear() { m_size = 0; }
+    /* only meant to shrink the list */
+    void resize(size_t n) { m_size = n; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    Move& operator[](size_t i) { return m_moves[i]; }
+    const Move& operator[](size_t i) const { return m_moves[i]; }
+    int32_t& score(size_t i) { return m_scores[i]; }
+    int32_t score(size_t i) const { return m_scores[i]; }
+
+    iterator begin() { return m_moves.data(); }
+    iterator end() { return m_moves.data() + m_size; }
+    const_iterator begin() const { return m_moves.data(); }
+    const_iterator end() const { return m_moves.data() + m_size; }
+
+    bool contains(Move m) const
+    {
+        return std::find(begin(), end(), m) != end();
     }
 
-    Move reverse() const
+    /**
+     * stable insertion sort of [begin, end) by decreasing score,
+     * lists are short enough that this beats std::sort
+     */
+    void sort(size_t begin, size_t end)
     {
-        if (!takes) {
-            throw chess_exception("cannot reverse if not capture");
-        }
-        Move m = *this;
-        m.dst = src;
-        m.src = dst;
-        m.takes = piece != P_EMPTY;
-        m.taken_piece = piece;
-        m.piece = taken_piece;
-        m.color = other_color(color);
-        if (m.takes && m.taken_piece == P_EMPTY) {
-            std::abort();
+        for (size_t i = begin + 1; i < end; ++i) {
+            Move m = m_moves[i];
+            int32_t s = m_scores[i];
+            size_t j = i;
+            for (; j > begin && m_scores[j - 1] < s; --j) {
+                m_moves[j] = m_moves[j - 1];
+                m_scores[j] = m_scores[j - 1];
+            }
+            m_moves[j] = m;
+            m_scores[j] = s;
         }
+    }
+    void sort() { sort(0, size()); }
+};
 
+inline Piece moved_piece(const Board& b, Move m) { return b.get_piece_at(m.src()); }
+inline Piece captured_piece(const Board& b, Move m)
+{
+    return m.is_en_passant() ? P_PAWN : b.get_piece_at(m.dst());
+}
+inline bool is_capture(const Board& b, Move m) { return captured_piece(b, m) != P_EMPTY; }
 
-        m.castling = castling;
+/**
+ * principal variation with fixed capacity,
+ * so that search nodes can hold one without allocating
+ */
+class PvLine
+{
+private:
+    Move m_moves[MAX_PLY];
+    size_t m_size;
 
-        m.promote = promote;
-        m.promote_piece = promote_piece;
+public:
+    PvLine() : m_size{ 0 } {}
+    PvLine(const PvLine& o) : m_size{ o.m_size }
+    {
+        std::copy(o.m_moves, o.m_moves + o.m_size, m_moves);
+    }
+    PvLine& operator=(const PvLine& o)
+    {
+        m_size = o.m_size;
+        std::copy(o.m_moves, o.m_moves + o.m_size, m_moves);
+        return *this;
+    }
 
-        m.m_board_state_before = m_board_state_before;
-        m.m_board_key_before = m_board_key_before;
-        m.half_move_before = half_move_before;
+    void push_back(Move m)
+    {
+        if (m_size < MAX_PLY) {
+            m_moves[m_size++] = m;
+        }
+    }
+    void clear() { m_size = 0; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
 
-        m.legal = legal;
-        m.legal_checked = legal_checked;
+    Move& operator[](size_t i) { return m_moves[i]; }
+    const Move& operator[](size_t i) const { return m_moves[i]; }
+    const Move* begin() const { return m_moves; }
+    const Move* end() const { return m_moves + m_size; }
 
-        return m;
+    /* this line becomes `m` followed by `child` */
+    void set(Move m, const PvLine& child)
+    {
+        m_moves[0] = m;
+        m_size = std::min(child.m_size + 1, MAX_PLY);
+        std::copy(child.m_moves, child.m_moves + (m_size - 1), m_moves + 1);
     }
+};
 
-private:
-
-}; // class Move
+struct Killer
+{
+    Move move; // none for an empty slot
+    bool mate; // killer that led to a mate score
+};
 
-using MoveList = std::vector<Move>;
-using MovePtrList = std::vector<Move*>;
-using KillerMoves = std::vector<MoveList>;
+// killers of one ply, oldest first
+using KillerSlots = std::array<Killer, NUM_KILLERS>;
+using KillerMoves = std::array<KillerSlots, MAX_PLY>;
 using HistoryMoves = std::vector<uint64_t>;
+// quiet move that refuted a move, indexed like history
+// by color, source and destination of the refuted move
+using CounterMoves = std::array<Move, 2 * 64 * 64>;
 
 
 inline constexpr std::string piece_to_move_letter(Piece p) {
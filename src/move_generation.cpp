@@ -4,20 +4,9 @@
 #include "./move_generation.hpp"
 #include "./engine.hpp"
 #include "./evaluation.hpp"
+#include "./attacks.hpp"
 
 
-bool can_en_passant(const Board &b, const Pos &src, const Pos &dst) {
-    Pos ep_pos = b.get_en_passant_pos();
-    if (ep_pos.row == 0)
-        return false;
-
-    if (ep_pos.column == dst.column && ep_pos.row == src.row)
-    {
-        return true;
-    }
-    return false;
-}
-
 inline constexpr uint8_t promote_row(Color clr) {
     return clr * 7; // WHITE=7 BLACK=0
 }
@@ -25,6 +14,21 @@ inline constexpr uint8_t start_row(Color clr) {
     return  6 - 5 * clr; // WHITE=1 BLACK=6
 }
 
+/**
+ * add a pawn move, or one move per promotion piece when reaching last row
+ */
+inline void add_pawn_move(
+    uint8_t src, uint8_t dst, bool can_promote, MoveList& moveList)
+{
+    if (can_promote) {
+        for (int p = P_BISHOP; p <= P_QUEEN; ++p) {
+            moveList.push_back(Move{ src, dst, MF_PROMOTE, (Piece)p });
+        }
+    } else {
+        moveList.push_back(Move{ src, dst });
+    }
+}
+
 void generate_pawn_move_dst(
     const Board& b, const Pos& dst, Color clr,  MoveList& moveList)
 {
@@ -42,22 +46,7 @@ void generate_pawn_move_dst(
     if (b.get_piece_at(src) == P_PAWN)
     {
         bool can_promote = dst.row == promote_row(clr);
-        Move m{ b };
-        m.src = src;
-        m.dst = dst;
-        m.takes = false;
-        m.piece = P_PAWN;
-        m.color = clr;
-        m.promote = can_promote;
-        if (can_promote) {
-            for (int p = P_BISHOP; p <= P_QUEEN; ++p) {
-                m.promote_piece = (Piece)p;
-                moveList.emplace_back(m);
-            }
-        } else {
-            m.promote_piece = P_EMPTY;
-            moveList.emplace_back(m);
-        }
+        add_pawn_move(src.to_val(), dst.to_val(), can_promote, moveList);
     }
     else if (b.get_piece_at(src) == P_EMPTY)
     {
@@ -65,14 +54,7 @@ void generate_pawn_move_dst(
         Pos src2{ u8(prevRow+offset), src.column};
         if (src2.row == start_row(clr)
             && b.get_piece_at(src2) == P_PAWN) {
-            Move m2{ b };
-            m2.src = src2;
-            m2.dst = dst;
-            m2.takes = false;
-            m2.piece = P_PAWN;
-            m2.color = clr;
-
-            moveList.emplace_back(m2);
+            moveList.push_back(Move{ src2.to_val(), dst.to_val() });
         }
     }
 }
@@ -89,129 +71,56 @@ void generate_pawn_move(
         return;
     }
 
+    const uint8_t src_sq = src.to_val();
     Pos dst{nextRow, src.column};
     bool can_promote = nextRow == promote_row(clr);
 
     if (b.get_piece_at(dst) == P_EMPTY && !only_takes)
     {
-        Move m{ b };
-        m.src = src;
-        m.dst = dst;
-        m.takes = false;
-        m.piece = b.get_piece_at(src);
-        m.color = clr;
-        m.promote = can_promote;
-        if (can_promote) {
-            for (int p = P_BISHOP; p <= P_QUEEN; ++p) {
-                m.promote_piece = (Piece)p;
-                moveList.emplace_back(m);
-            }
-        } else {
-            m.promote_piece = P_EMPTY;
-            moveList.emplace_back(m);
-        }
+        add_pawn_move(src_sq, dst.to_val(), can_promote, moveList);
 
         // initial pawn 2 square move
         Pos dst2{ u8(nextRow+offset), src.column};
         if (src.row == start_row(clr)
             && b.get_piece_at(dst2) == P_EMPTY) {
-            Move m2{ b };
-            m2.src = src;
-            m2.dst = dst2;
-            m2.takes = false;
-            m2.piece = b.get_piece_at(src);
-            m2.color = clr;
-
-            moveList.emplace_back(m2);
+            moveList.push_back(Move{ src_sq, dst2.to_val() });
         }
     }
 
-    Pos dsts[2];
-    dsts[0] = Pos(nextRow, src.column - 1);
-    dsts[1] = Pos(nextRow, src.column + 1);
-    for (const auto &dst : dsts) {
-        if (dst.row > 7 || dst.column > 7) {
-            continue;
-        }
-        Color dst_color = b.get_color_at(dst);
-        bool en_passant = can_en_passant(b, src, dst);
-        if (dst_color == other_color(clr) || en_passant)
-        {
+    // captures
+    Bitboard targets = b.get_color_pieces(other_color(clr)) & pawn_attacks(clr, src_sq);
+    while (targets) {
+        add_pawn_move(src_sq, pop_lsb(targets), can_promote, moveList);
+    }
 
-            Move m{ b };
-            m.src = src;
-            m.dst = dst;
-            m.takes = true;
-            m.piece = b.get_piece_at(src);
-            m.taken_piece = en_passant ? P_PAWN : b.get_piece_at(dst);
-            if (m.taken_piece == P_EMPTY) {
-                std::abort();
-            }
-            m.color = clr;
-            m.en_passant = en_passant;
-            m.promote = can_promote;
-            if (can_promote) {
-                for (int p = P_BISHOP; p <= P_QUEEN; ++p) {
-                    m.promote_piece = (Piece)p;
-                    moveList.emplace_back(m);
-                }
-            }
-            else {
-                m.promote_piece = P_EMPTY;
-                moveList.emplace_back(m);
-            }
+    // en passant
+    Pos ep_pos = b.get_en_passant_pos();
+    if (b.has_en_passant() && ep_pos.row == src.row) {
+        Pos ep_dst{ nextRow, ep_pos.column };
+        if (pawn_attacks(clr, src_sq) & square_bb(ep_dst)) {
+            moveList.push_back(Move{ src_sq, ep_dst.to_val(), MF_EN_PASSANT });
         }
     }
 }
 
-
-struct Direction {
-    Vec offset;
-    int maxrange;
-};
-
-void generate_move_for_direction(
-    const Board& b, const Pos& initial_pos, Color clr,
-    const Direction& dir, MoveList& moveList, bool only_takes)
+/**
+ * squares a piece of color `clr` may move to:
+ * anything but own pieces, or only enemy pieces for captures
+ */
+inline Bitboard target_squares(const Board& b, Color clr, bool only_takes)
 {
-    Pos pos = initial_pos;
-    Piece piece = b.get_piece_at(initial_pos);
-
-    for (int distance = 1; distance <= dir.maxrange; ++distance) {
-        bool takes = false;
-        pos.row = initial_pos.row + distance * dir.offset.row;
-        pos.column = initial_pos.column + distance * dir.offset.column;
-        if (pos.row >7 || pos.column > 7) {
-            break;
-        }
+    return only_takes
+        ? b.get_color_pieces(other_color(clr))
+        : ~b.get_color_pieces(clr);
+}
 
-        Color dstClr = b.get_color_at(pos);
-        if (dstClr == clr) {
-            break; // cannot jump / go to over own pieces
-        }
-        else if (dstClr != C_EMPTY) {
-            takes = true;
-        }
-        if (!takes && only_takes)
-        {
-            continue;
-        }
-        Move m{ b };
-
-        m.piece = piece;
-        m.color = clr;
-        m.src = initial_pos;
-        m.dst = pos;
-        m.takes = takes;
-        m.taken_piece = b.get_piece_at(pos);
-        if (m.takes && m.taken_piece == P_EMPTY)
-        {
-            std::abort();
-        }
-        moveList.emplace_back(m);
-        if (takes) {
-            break;
-        }
+/**
+ * add one move from `src` to each square of `targets`
+ */
+inline void add_moves_to_targets(uint8_t src, Bitboard targets, MoveList& moveList)
+{
+    while (targets) {
+        moveList.push_back(Move{ src, pop_lsb(targets) });
     }
 }
 
@@ -219,156 +128,76 @@ void generate_bishop_move(
     const Board& b, const Pos& pos, Color clr,
     MoveList& moveList, bool only_takes)
 {
-    Direction dirs[4] = {
-        { {-1, -1}, 8 },
-        { {-1, +1}, 8 },
-        { {+1, -1}, 8 },
-        { {+1, +1}, 8 },
-    };
-    for (const auto& dir : dirs) {
-        generate_move_for_direction(b, pos, clr, dir, moveList, only_takes);
-    }
+    Bitboard targets = bishop_attacks(pos.to_val(), b.get_occupied())
+        & target_squares(b, clr, only_takes);
+    add_moves_to_targets(pos.to_val(), targets, moveList);
 }
 
-Direction knight_directions[8] = {
-    { {-1, -2}, 1 },
-    { {-1, +2}, 1 },
-    { {-2, +1}, 1 },
-    { {-2, -1}, 1 },
-    { {+1, -2}, 1 },
-    { {+1, +2}, 1 },
-    { {+2, +1}, 1 },
-    { {+2, -1}, 1 },
-};
 void generate_knight_move(const Board& b, const Pos& pos, Color clr, MoveList& moveList, bool only_takes)
 {
-    for (auto& dir : knight_directions) {
-        generate_move_for_direction(b, pos, clr, dir, moveList, only_takes);
-    }
+    Bitboard targets = knight_attacks(pos.to_val()) & target_squares(b, clr, only_takes);
+    add_moves_to_targets(pos.to_val(), targets, moveList);
 }
 
-Direction rook_directions[4] = {
-    { {-1, +0}, 8 },
-    { {+1, +0}, 8 },
-    { {+0, +1}, 8 },
-    { {+0, -1}, 8 },
-};
 void generate_rook_move(const Board& b, const Pos& pos, Color clr, MoveList& moveList, bool only_takes)
 {
-    for (auto& dir : rook_directions) {
-        generate_move_for_direction(b, pos, clr, dir, moveList, only_takes);
-    }
+    Bitboard targets = rook_attacks(pos.to_val(), b.get_occupied())
+        & target_squares(b, clr, only_takes);
+    add_moves_to_targets(pos.to_val(), targets, moveList);
 }
 
-constexpr Direction king_directions[8] = {
- // like rook
- { {-1, +0}, 1 },
- { {+1, +0}, 1 },
- { {+0, +1}, 1 },
- { {+0, -1}, 1 },
- // like bishop
- { {-1, -1}, 1 },
- { {-1, +1}, 1 },
- { {+1, -1}, 1 },
- { {+1, +1}, 1 },
-};
-constexpr Direction queen_directions[8] = {
-    // like rook
-     { {-1, +0}, 8 },
-     { {+1, +0}, 8 },
-     { {+0, +1}, 8 },
-     { {+0, -1}, 8 },
-     // like bishop
-     { {-1, -1}, 8 },
-     { {-1, +1}, 8 },
-     { {+1, -1}, 8 },
-     { {+1, +1}, 8 },
-};
-
 void generate_king_move(const Board& b, const Pos& pos, Color clr, MoveList& moveList, bool only_takes)
 {
-    for (auto& dir : king_directions) {
-        generate_move_for_direction(b, pos, clr, dir, moveList, only_takes);
-    }
+    Bitboard targets = king_attacks(pos.to_val()) & target_squares(b, clr, only_takes);
+    add_moves_to_targets(pos.to_val(), targets, moveList);
 }
+
 void generate_queen_move(const Board& b, const Pos& pos, Color clr, MoveList& moveList, bool only_takes)
 {
-    for (auto& dir : queen_directions) {
-        generate_move_for_direction(b, pos, clr, dir, moveList, only_takes);
-    }
+    Bitboard targets = queen_attacks(pos.to_val(), b.get_occupied())
+        & target_squares(b, clr, only_takes);
+    add_moves_to_targets(pos.to_val(), targets, moveList);
 }
 
 
-void gen_castle_king_side(
-    Board& b, const Pos& pos, Color clr, MoveList& moveList)
+/**
+ * the castle right is held, the squares between king and rook are empty
+ * and the king neither starts, crosses nor lands on an attacked square
+ */
+bool can_castle(const Board& b, Color clr, bool king_side, const AttackInfo* ai)
 {
-    auto rights = b.get_castle_rights();
-    auto idxKing = clr == C_WHITE ? CR_KING_WHITE : CR_KING_BLACK;
-    if ((rights & idxKing) == 0) {
-        return;
+    // squares of the first row, shifted to the king row
+    constexpr Bitboard F_G = 0x60_u64;
+    constexpr Bitboard E_F_G = 0x70_u64;
+    constexpr Bitboard B_C_D = 0x0E_u64;
+    constexpr Bitboard C_D_E = 0x1C_u64;
+
+    uint8_t right = king_side
+        ? (clr == C_WHITE ? CR_KING_WHITE : CR_KING_BLACK)
+        : (clr == C_WHITE ? CR_QUEEN_WHITE : CR_QUEEN_BLACK);
+    if ((b.get_castle_rights() & right) == 0) {
+        return false;
     }
-    for (uint8_t i = 5; i <= 6; ++i) {
-        if (b.get_piece_at(Pos{ pos.row, i }) != P_EMPTY)
-        {
-            return;
-        }
+    const uint8_t shift = 8 * b.get_king_pos(clr).row;
+    if (b.get_occupied() & ((king_side ? F_G : B_C_D) << shift)) {
+        return false;
     }
-
-    for (uint8_t i = 4; i <= 6; ++i) {
-        if (b.is_square_attacked(Pos{ pos.row, i }, other_color(clr)))
-        {
-            return;
-        }
+    const Bitboard king_path = (king_side ? E_F_G : C_D_E) << shift;
+    if (ai) {
+        return !ai->is_any_attacked(king_path, other_color(clr));
     }
-    //if ((pos.row != 7 && clr == C_BLACK)
-    //    || (pos.row != 0 && clr == C_WHITE)) {
-    //    throw std::exception("invalid castle state (5)");
-    //}
-
-    Move OO{ b };
-    OO.src = pos;
-    OO.dst = Pos{ u8(pos.to_val()+2) };
-    OO.piece = P_KING;
-    OO.color = clr;
-    OO.castling = true;
-
-    moveList.emplace_back(OO);
+    return !b.is_any_square_attacked(king_path, other_color(clr));
 }
 
-void gen_castle_queen_side(
-    Board& b, const Pos& pos, Color clr, MoveList& moveList)
+void generate_castle_move(
+    const Board& b, const Pos& pos, Color clr, MoveList& moveList, const AttackInfo* ai)
 {
-    auto rights = b.get_castle_rights();
-    auto idxQueen = clr == C_WHITE ? CR_QUEEN_WHITE : CR_QUEEN_BLACK;
-    if ((rights & idxQueen) == 0) {
-        return;
+    if (can_castle(b, clr, true, ai)) {
+        moveList.push_back(Move{ pos.to_val(), u8(pos.row * 8 + 6), MF_CASTLING });
     }
-    for (uint8_t i = 3; i >= 1; --i) {
-        if (b.get_piece_at(Pos{ pos.row, i }) != P_EMPTY) {
-            return;
-        }
+    if (can_castle(b, clr, false, ai)) {
+        moveList.push_back(Move{ pos.to_val(), u8(pos.row * 8 + 2), MF_CASTLING });
     }
-    for (uint8_t i = 4; i >= 2; --i) {
-        if (b.is_square_attacked( Pos{ pos.row, i}, other_color(clr)))
-        {
-            return;
-        }
-    }
-
-    Move OOO{ b };
-    OOO.src = pos;
-    OOO.dst = Pos{ u8(pos.to_val() - 2) };
-    OOO.piece = P_KING;
-    OOO.color = clr;
-    OOO.castling = true;
-    moveList.emplace_back(OOO);
-}
-
-void generate_castle_move(
-    Board& b, const Pos& pos, Color clr, MoveList& moveList)
-{
-    gen_castle_king_side(b, pos, clr, moveList);
-    gen_castle_queen_side(b, pos, clr, moveList);
 }
 
 
@@ -376,105 +205,61 @@ void find_move_to_position(
     Board& b, const Pos& pos, MoveList& moveList,
     Color move_clr, int16_t max_move, bool only_takes)
 {
-    // generate "reversed move" starting from destination and other color
-    // and then "reverse" the moves
+    // look up pieces of `move_clr` attacking the destination
+    // with the attack sets of each piece type computed from the destination
     Piece at_dst = b.get_piece_at(pos);
     if (only_takes &&  at_dst == P_EMPTY)
     {
         return;
     }
 
-    Color enemy_clr = other_color(move_clr);
-
-    {
-        MoveList tmpList;
-        generate_bishop_move(b, pos, enemy_clr, tmpList, only_takes);
-        for (const auto& m : tmpList)
-        {
-            if (m.taken_piece == P_BISHOP || m.taken_piece == P_QUEEN)
-            {
-                moveList.emplace_back(m.reverse());
-                if (max_move > 0 && moveList.size() >= max_move) {
-                    return;
-                }
+    const uint8_t dst = pos.to_val();
+    const Bitboard occupied = b.get_occupied();
+    auto add_attackers = [&](Bitboard attackers) {
+        while (attackers) {
+            moveList.push_back(Move{ pop_lsb(attackers), dst });
+            if (max_move > 0 && moveList.size() >= (size_t)max_move) {
+                return true;
             }
         }
-    }
+        return false;
+    };
 
-    {
-        MoveList tmpList;
-        generate_rook_move(b, pos, enemy_clr, tmpList, only_takes);
-        for (const auto& m : tmpList) {
-            if (m.taken_piece == P_ROOK || m.taken_piece == P_QUEEN) {
-                moveList.emplace_back(m.reverse());
-                if (max_move > 0 && moveList.size() >= max_move) {
-                    return;
-                }
-            }
-        }
+    Bitboard queens = b.get_pieces(move_clr, P_QUEEN);
+    if (add_attackers(bishop_attacks(dst, occupied) & (b.get_pieces(move_clr, P_BISHOP) | queens))) {
+        return;
     }
-
-    {
-        MoveList tmpList;
-        generate_knight_move(b, pos, enemy_clr, tmpList, only_takes);
-        for (const auto& m : tmpList) {
-            if (m.taken_piece == P_KNIGHT)
-            {
-                moveList.emplace_back(m.reverse());
-                if (max_move > 0 && moveList.size() >= max_move) {
-                    return;
-                }
-            }
-        }
+    if (add_attackers(rook_attacks(dst, occupied) & (b.get_pieces(move_clr, P_ROOK) | queens))) {
+        return;
+    }
+    if (add_attackers(knight_attacks(dst) & b.get_pieces(move_clr, P_KNIGHT))) {
+        return;
     }
 
+    if (at_dst != P_EMPTY)
     {
-        if (at_dst != P_EMPTY)
-        {
-            // only takes here
-            MoveList tmpList;
-            generate_pawn_move(b, pos, enemy_clr, tmpList, true);
-            for (const auto& m : tmpList)
-            {
-                if (m.taken_piece == P_PAWN)
-                {
-                    moveList.emplace_back(m.reverse());
-                    if (max_move > 0 && moveList.size() >= max_move) {
-                        return;
-                    }
-                }
-            }
-        }
-
-        if (!only_takes)
-        {
-            MoveList tmpList;
-            generate_pawn_move_dst(b, pos, move_clr, tmpList);
-            for (const auto& m : tmpList)
-            {
-                moveList.emplace_back(m);
-                if (max_move > 0 && moveList.size() >= max_move) {
-                    return;
-                }
+        // only takes here
+        bool can_promote = pos.row == promote_row(move_clr);
+        Bitboard pawns = pawn_attacks(other_color(move_clr), dst) & b.get_pieces(move_clr, P_PAWN);
+        while (pawns) {
+            add_pawn_move(pop_lsb(pawns), dst, can_promote, moveList);
+            if (max_move > 0 && moveList.size() >= (size_t)max_move) {
+                moveList.resize(max_move);
+                return;
             }
         }
     }
 
+    if (!only_takes)
     {
-        MoveList tmpList;
-        // maxdist = 1 for enemy king
-        generate_king_move(b, pos, enemy_clr, tmpList, true);
-        for (const auto& m : tmpList)
-        {
-            if (m.taken_piece == P_KING)
-            {
-                moveList.emplace_back(m.reverse());
-                if (max_move > 0 && moveList.size() >= max_move) {
-                    return;
-                }
-            }
+        generate_pawn_move_dst(b, pos, move_clr, moveList);
+        if (max_move > 0 && moveList.size() >= (size_t)max_move) {
+            moveList.resize(max_move);
+            return;
         }
     }
+
+    add_attackers(king_attacks(dst) & b.get_pieces(move_clr, P_KING));
 }
 
 void add_move_from_position(
@@ -515,101 +300,270 @@ void add_move_from_position(
     }
 }
 
-void remove_duplicate_moves(MoveList &ml)
+/**
+ * squares that give a direct check to the enemy king, per piece type,
+ * and pieces that may give a discovered check by leaving their line
+ */
+struct QuietCheckInfo
 {
-    int invalid_count = 0;
-    for (size_t i = 1; i < ml.size(); ++i) {
+    Bitboard check_squares[P_NUM_PIECE];
+    Bitboard discovered;
+    uint8_t king_sq;
+};
 
-        for (size_t j = 0; j < i; ++j) {
-            if (ml[j].legal_checked) {
-                continue;
-            }
-            if (ml[i] == ml[j]) {
-                ml[i].legal_checked = true;
-                ml[i].legal = false;
-                ++invalid_count;
-                break;
+template<Color clr>
+static QuietCheckInfo compute_quiet_check_info(const Board& b)
+{
+    QuietCheckInfo qc;
+    const Bitboard occupied = b.get_occupied();
+    qc.king_sq = b.get_king_pos(other_color(clr)).to_val();
+    qc.discovered = b.discovered_check_candidates(clr);
+    std::fill(std::begin(qc.check_squares), std::end(qc.check_squares), 0);
+    qc.check_squares[P_PAWN] = pawn_attacks(other_color(clr), qc.king_sq);
+    qc.check_squares[P_KNIGHT] = knight_attacks(qc.king_sq);
+    qc.check_squares[P_BISHOP] = bishop_attacks(qc.king_sq, occupied);
+    qc.check_squares[P_ROOK] = rook_attacks(qc.king_sq, occupied);
+    qc.check_squares[P_QUEEN] = qc.check_squares[P_BISHOP] | qc.check_squares[P_ROOK];
+    return qc;
+}
+
+/* shift a whole set one row toward the promotion row of `clr` */
+template<Color clr>
+inline constexpr Bitboard shift_up(Bitboard bb)
+{
+    return clr == C_WHITE ? bb << 8 : bb >> 8;
+}
+
+/* add one move per destination in `dsts`, the source is `dst - offset` */
+inline void add_shifted_moves(Bitboard dsts, int offset, MoveList& moveList)
+{
+    while (dsts) {
+        uint8_t dst = pop_lsb(dsts);
+        moveList.push_back(Move{ u8(dst - offset), dst });
+    }
+}
+
+inline void add_shifted_promotions(Bitboard dsts, int offset, MoveList& moveList)
+{
+    while (dsts) {
+        uint8_t dst = pop_lsb(dsts);
+        add_pawn_move(u8(dst - offset), dst, true, moveList);
+    }
+}
+
+/**
+ * moves of all pawns at once, pushes may only land on `push_targets`
+ * and captures on `capture_targets`
+ */
+template<Color clr, GenType type>
+static void generate_pawn_moves(
+    const Board& b, Bitboard push_targets, Bitboard capture_targets,
+    const QuietCheckInfo& qc, MoveList& moveList)
+{
+    constexpr int up = clr == C_WHITE ? 8 : -8;
+    constexpr Bitboard last_rank = rank_bb(promote_row(clr));
+    // pawns that reached it after a first push may push again
+    constexpr Bitboard third_rank = rank_bb(clr == C_WHITE ? 2 : 5);
+
+    const Bitboard pawns = b.get_pieces(clr, P_PAWN);
+    const Bitboard empty = ~b.get_occupied();
+
+    if constexpr (type != GT_CAPTURES) {
+        Bitboard single = shift_up<clr>(pawns) & empty;
+        Bitboard twice = shift_up<clr>(single & third_rank) & empty;
+        if constexpr (type == GT_QUIET_CHECKS) {
+            // leaving a diagonal or a row always uncovers the slider
+            Bitboard dc_pawns = qc.discovered & ~file_bb(qc.king_sq & 7);
+            Bitboard dc_single = shift_up<clr>(pawns & dc_pawns);
+            single &= ~last_rank & (push_targets | dc_single);
+            twice &= push_targets | shift_up<clr>(dc_single);
+        }
+        else {
+            twice &= push_targets;
+            single &= push_targets;
+            add_shifted_promotions(single & last_rank, up, moveList);
+            single &= ~last_rank;
+        }
+        add_shifted_moves(single, up, moveList);
+        add_shifted_moves(twice, 2 * up, moveList);
+    }
+
+    if constexpr (type == GT_CAPTURES || type == GT_EVASIONS || type == GT_ALL) {
+        // toward column a then column h, as seen from the white side
+        constexpr int left = clr == C_WHITE ? 7 : -9;
+        constexpr int right = clr == C_WHITE ? 9 : -7;
+        Bitboard to_left = shift_up<clr>(pawns & ~FILE_A_BB) >> 1;
+        Bitboard to_right = shift_up<clr>(pawns & ~FILE_H_BB) << 1;
+        to_left &= capture_targets;
+        to_right &= capture_targets;
+        add_shifted_promotions(to_left & last_rank, left, moveList);
+        add_shifted_promotions(to_right & last_rank, right, moveList);
+        add_shifted_moves(to_left & ~last_rank, left, moveList);
+        add_shifted_moves(to_right & ~last_rank, right, moveList);
+
+        if (b.has_en_passant()) {
+            // legality (e.g. the checker is not the taken pawn) left to is_legal
+            const uint8_t ep_dst = u8(b.get_en_passant_pos().to_val() + up);
+            Bitboard takers = pawn_attacks(other_color(clr), ep_dst) & pawns;
+            while (takers) {
+                moveList.push_back(Move{ pop_lsb(takers), ep_dst, MF_EN_PASSANT });
             }
         }
     }
-    // compact
-    for (size_t i = 1; i < ml.size(); ++i)
-    {
-        if (ml[i].legal_checked) {
-            continue;
-        }
-        for (size_t j = 0; j < i; ++j) {
-            if (ml[j].legal_checked) {
-                std::swap(ml[i], ml[j]);
-                continue;
+}
+
+template<Color clr, GenType type, Piece p>
+static void generate_piece_moves(
+    const Board& b, Bitboard targets, const QuietCheckInfo& qc, MoveList& moveList)
+{
+    const Bitboard occupied = b.get_occupied();
+    Bitboard pieces = b.get_pieces(clr, p);
+    while (pieces) {
+        const uint8_t src = pop_lsb(pieces);
+        Bitboard dsts = piece_attacks(p, clr, src, occupied) & targets;
+        if constexpr (type == GT_QUIET_CHECKS) {
+            Bitboard checks = qc.check_squares[p];
+            if (qc.discovered & square_bb(src)) {
+                checks |= ~line_bb(qc.king_sq, src);
             }
+            dsts &= checks;
         }
+        add_moves_to_targets(src, dsts, moveList);
     }
-    ml.resize(ml.size() - invalid_count);
 }
 
-void generate_check_evading_moves(MoveList &res, Board& b)
+template<Color clr, GenType type>
+void generate(const Board& b, MoveList& moveList, const AttackInfo* ai)
 {
-    Color clr = b.get_next_move();
-    Pos kpos = b.get_king_pos(clr);
-    MoveList king_attacks;
-    find_move_to_position(b, kpos, king_attacks, other_color(clr), 2, true);
-    bool double_check = king_attacks.size() > 1;
+    constexpr Color them = other_color(clr);
+    const Bitboard own = b.get_color_pieces(clr);
+    const Bitboard enemies = b.get_color_pieces(them);
+    const Bitboard empty = ~(own | enemies);
+    const uint8_t king_sq = b.get_king_pos(clr).to_val();
 
-    if (double_check)
-    {
-        // move king out of the way
-        generate_king_move(b, kpos, clr, res, false);
-        return;
+    QuietCheckInfo qc;
+    if constexpr (type == GT_QUIET_CHECKS) {
+        qc = compute_quiet_check_info<clr>(b);
     }
-    if (king_attacks.size() == 0) {
-        throw chess_exception("no checks ??");
+
+    Bitboard targets = 0;
+    Bitboard push_targets = 0;
+    Bitboard capture_targets = 0;
+    if constexpr (type == GT_EVASIONS) {
+        const Bitboard checkers = b.checkers();
+        if (checkers && (checkers & (checkers - 1)) == 0) {
+            push_targets = between_bb(king_sq, lsb(checkers));
+            capture_targets = checkers;
+            targets = push_targets | capture_targets;
+        }
+        // in double check only the king can move: all targets stay empty
     }
-    auto& attacker_pos = king_attacks[0].src;
-    Piece checker = b.get_piece_at(attacker_pos);
-    if (checker == P_KNIGHT)
-    {
-        // capture the knight
-        find_move_to_position(b, attacker_pos, res, clr, -1, true);
-        // or move out of the way
-        generate_king_move(b, kpos, clr, res, false);
-        return;
+    else if constexpr (type == GT_CAPTURES) {
+        targets = capture_targets = enemies;
+    }
+    else if constexpr (type == GT_ALL) {
+        targets = ~own;
+        push_targets = empty;
+        capture_targets = enemies;
+    }
+    else { // GT_QUIETS, GT_QUIET_CHECKS
+        targets = push_targets = empty;
+    }
+    if constexpr (type == GT_QUIET_CHECKS) {
+        push_targets = qc.check_squares[P_PAWN] & empty;
+    }
+
+    if (targets) {
+        generate_pawn_moves<clr, type>(b, push_targets, capture_targets, qc, moveList);
+        generate_piece_moves<clr, type, P_KNIGHT>(b, targets, qc, moveList);
+        generate_piece_moves<clr, type, P_BISHOP>(b, targets, qc, moveList);
+        generate_piece_moves<clr, type, P_ROOK>(b, targets, qc, moveList);
+        generate_piece_moves<clr, type, P_QUEEN>(b, targets, qc, moveList);
     }
-    else
-    {
-        // capture the piece
-        find_move_to_position(b, attacker_pos, res, clr, -1, true);
-
-        int rd = attacker_pos.row - kpos.row;
-        int ro = rd / std::max(std::abs(rd), 1);
-        int cd = attacker_pos.column - kpos.column;
-        int co = cd / std::max(std::abs(cd), 1);
-
-        // block the attack
-        for (uint8_t i = kpos.row+ro, j = kpos.column+co;
-             i != attacker_pos.row || j != attacker_pos.column;
-             i += ro, j += co)
-        {
-            find_move_to_position(b, Pos{ i,j }, res, clr, -1, false);
-        }
-        // or move out of the way
-        generate_king_move(b, kpos, clr, res, false);
 
-        remove_duplicate_moves(res);
+    Bitboard king_targets = type == GT_CAPTURES ? enemies
+        : type == GT_QUIETS || type == GT_QUIET_CHECKS ? empty
+        : ~own;
+    if constexpr (type == GT_QUIET_CHECKS) {
+        // a king never checks directly
+        king_targets &= (qc.discovered & square_bb(king_sq)) ? ~line_bb(qc.king_sq, king_sq) : 0;
+    }
+    add_moves_to_targets(king_sq, king_attacks(king_sq) & king_targets, moveList);
+
+    if constexpr (type == GT_QUIETS || type == GT_ALL) {
+        generate_castle_move(b, Pos{ king_sq }, clr, moveList, ai);
     }
 }
 
-void generate_pseudo_moves(MoveList &moveList, Board& b, bool only_takes)
+template void generate<C_WHITE, GT_CAPTURES>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_WHITE, GT_QUIETS>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_WHITE, GT_EVASIONS>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_WHITE, GT_QUIET_CHECKS>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_WHITE, GT_ALL>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_BLACK, GT_CAPTURES>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_BLACK, GT_QUIETS>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_BLACK, GT_EVASIONS>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_BLACK, GT_QUIET_CHECKS>(const Board&, MoveList&, const AttackInfo*);
+template void generate<C_BLACK, GT_ALL>(const Board&, MoveList&, const AttackInfo*);
+
+template<Color clr>
+static void generate_for_type(
+    MoveList& moveList, const Board& b, GenType type, const AttackInfo* ai)
 {
-    Color to_move = b.get_next_move();
-    for (uint8_t i = 0; i < 64; ++i) {
-        Pos pos{ i };
-        Color clr = b.get_color_at(pos);
-        if (clr != to_move) {
-            continue;
+    switch (type) {
+    case GT_CAPTURES: generate<clr, GT_CAPTURES>(b, moveList, ai); break;
+    case GT_QUIETS: generate<clr, GT_QUIETS>(b, moveList, ai); break;
+    case GT_EVASIONS: generate<clr, GT_EVASIONS>(b, moveList, ai); break;
+    case GT_QUIET_CHECKS: generate<clr, GT_QUIET_CHECKS>(b, moveList, ai); break;
+    case GT_ALL: generate<clr, GT_ALL>(b, moveList, ai); break;
+    }
+}
+
+static void generate_pseudo_moves(
+    MoveList &moveList, const Board& b, GenType type, const AttackInfo* ai)
+{
+    if (b.get_next_move() == C_WHITE) {
+        generate_for_type<C_WHITE>(moveList, b, type, ai);
+    }
+    else {
+        generate_for_type<C_BLACK>(moveList, b, type, ai);
+    }
+}
+
+void generate_pseudo_moves(MoveList &moveList, const Board& b, GenType type)
+{
+    generate_pseudo_moves(moveList, b, type, nullptr);
+}
+
+static void generate_legal_moves(
+    MoveList &moveList, const Board& b, GenType type,
+    Bitboard pinned, Bitboard checkers, const AttackInfo* ai)
+{
+    if (checkers && type == GT_ALL) {
+        type = GT_EVASIONS;
+    }
+    size_t first = moveList.size();
+    generate_pseudo_moves(moveList, b, type, ai);
+
+    size_t count = first;
+    for (size_t i = first; i < moveList.size(); ++i) {
+        if (b.is_legal(moveList[i], pinned, checkers)) {
+            moveList[count++] = moveList[i];
         }
-        add_move_from_position(b, pos, moveList, only_takes);
     }
+    moveList.resize(count);
+}
+
+void generate_legal_moves(MoveList &moveList, const Board& b, GenType type)
+{
+    generate_legal_moves(
+        moveList, b, type, b.pinned_pieces(b.get_next_move()), b.checkers(), nullptr);
+}
+
+void generate_legal_moves(
+    MoveList &moveList, const Board& b, GenType type, const AttackInfo& ai)
+{
+    generate_legal_moves(moveList, b, type, ai.pinned, ai.checkers, &ai);
 }
 
 bool generate_move_for_squares(
@@ -618,7 +572,7 @@ bool generate_move_for_squares(
     MoveList ml;
     add_move_from_position(b, src, ml, false);
     for (const auto& m : ml) {
-        if (m.dst == dst && m.promote_piece == promote_piece) {
+        if (m.dst() == dst && m.promote_piece() == promote_piece) {
             out = m;
             return true;
         }
@@ -630,12 +584,9 @@ bool generate_move_for_squares(
 
 void enumerate_attacks(Board& b, Color to_move, MoveList &moveList)
 {
-    for (uint8_t i = 0; i < 64; ++i) {
-        Pos pos{ i };
-        Color clr = b.get_color_at(pos);
-        if (clr != to_move) {
-            continue;
-        }
+    Bitboard own = b.get_color_pieces(to_move);
+    while (own) {
+        Pos pos{ pop_lsb(own) };
         add_move_from_position(b, pos, moveList, /*attacks*/true);
     }
 }
@@ -661,80 +612,86 @@ Pos square_name_to_pos(const std::string& s) {
     };
 }
 
-std::string move_to_string(const Move& m)
+std::string move_to_string(const Board& b, Move m)
 {
     std::string res = "";
+    Piece piece = moved_piece(b, m);
+    bool takes = is_capture(b, m);
 
-    res += piece_to_move_letter(m.piece);
-    if (m.piece == P_PAWN && m.takes)
+    res += piece_to_move_letter(piece);
+    if (piece == P_PAWN && takes)
     {
-        res += col_name(m.src.column);
+        res += col_name(m.src().column);
     }
-    if (m.takes) {
+    if (takes) {
         res += "x";
     }
-    res += pos_to_square_name(m.dst);
-
-    if (m.promote) {
-        res += std::string("=") + piece_to_move_letter(m.promote_piece);
-    }
+    res += pos_to_square_name(m.dst());
 
-    if (m.mate) {
-        res += "#";
-    }
-    else if (m.checks) {
-        res += "+";
+    if (m.is_promote()) {
+        res += std::string("=") + piece_to_move_letter(m.promote_piece());
     }
     return res;
 }
 
-std::string move_to_string_disambiguate(Board &b, const Move& m)
+/**
+ * true if side to move has at least one legal move
+ */
+bool has_legal_move(const Board& b)
 {
-    std::string res = move_to_string(m);
-    if (m.piece == P_PAWN || m.piece == P_KING) {
-        return res;
-    }
-    MoveList move_candidates;
-    find_move_to_position(b, m.dst, move_candidates, m.color, -1, m.takes);
-    int num_same_piece = 0;
-    for (auto& c : move_candidates) {
-        if (c.src != m.src && c.piece == m.piece) {
-            ++num_same_piece;
-        }
-    }
-    
-    if (num_same_piece >= 1)
-    {
+    MoveList ml;
+    generate_legal_moves(ml, b);
+    return !ml.empty();
+}
+
+std::string move_to_string_disambiguate(Board &b, Move m)
+{
+    std::string res = move_to_string(b, m);
+    Piece piece = moved_piece(b, m);
+    Pos src = m.src();
+    if (piece != P_PAWN && piece != P_KING) {
+        // other pieces of the same type that can legally reach dst
+        const AttackInfo ai(b);
+        const uint8_t dst = m.dst_sq();
+        Bitboard others = b.attackers_to(dst, b.get_occupied())
+            & b.get_pieces(b.get_next_move(), piece) & ~square_bb(src);
         bool has_on_same_row = false;
         bool has_on_same_column = false;
-        for (auto& candidate : move_candidates)
-        {
-            if (candidate.piece == m.piece && candidate.src != m.src)
-            {
-                if (candidate.src.column == m.src.column) {
-                    has_on_same_row = true;
-                }
-                if (candidate.src.row == m.src.row) {
-                    has_on_same_row = true;
-                }
+        int num_same_piece = 0;
+        while (others) {
+            Pos other{ pop_lsb(others) };
+            if (!b.is_legal(Move{ other.to_val(), dst }, ai.pinned, ai.checkers)) {
+                continue;
             }
+            ++num_same_piece;
+            has_on_same_column |= other.column == src.column;
+            has_on_same_row |= other.row == src.row;
         }
-        std::string extra;
-        if (has_on_same_row || has_on_same_column)
+
+        if (num_same_piece >= 1)
         {
-            if (has_on_same_row) {
-                extra += col_name(m.src.column);
+            std::string extra;
+            if (has_on_same_column)
+            {
+                // file does not tell them apart
+                if (has_on_same_row) {
+                    extra += col_name(src.column);
+                }
+                extra += row_name(src.row);
             }
-            if (has_on_same_column) {
-                extra += row_name(m.src.row);
+            else
+            {
+                extra += col_name(src.column);
             }
+            res = res.substr(0, 1) + extra + res.substr(1);
         }
-        else
-        {
-            extra += col_name(m.src.column);
-        }
-        res = res.substr(0, 1) + extra + res.substr(1);
     }
+
+    b.make_move(m);
+    if (b.is_king_checked(b.get_next_move())) {
+        res += has_legal_move(b) ? "+" : "#";
+    }
+    b.unmake_move(m);
     return res;
 }
 
@@ -743,9 +700,8 @@ std::string move_to_uci_string(const Move& m)
 {
     return fmt::format(
         "{}{}{}",
-        pos_to_square_name(m.src),
-        pos_to_square_name(m.dst),
-        m.promote ? get_char_by_piece_pgn(m.promote_piece) : ""
+        pos_to_square_name(m.src()),
+        pos_to_square_name(m.dst()),
+        m.is_promote() ? get_char_by_piece_pgn(m.promote_piece()) : ""
     );
 }
-
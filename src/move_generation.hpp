@@ -6,10 +6,36 @@ class Board;
 
 #include "./board.hpp"
 #include "./move.hpp"
+#include "./attack_info.hpp"
 
-void generate_pseudo_moves(MoveList &out, Board& b, bool only_takes=false);
+/**
+ * kind of moves to generate, CAPTURES and QUIETS together are ALL
+ */
+enum GenType : uint8_t {
+    GT_CAPTURES = 0,   // captures, en passant and capture-promotions
+    GT_QUIETS,         // non captures, push-promotions and castling included
+    GT_EVASIONS,       // side to move is in check: king moves, capture or block the checker
+    GT_QUIET_CHECKS,   // non captures giving a direct or discovered check, no promotion nor castling
+    GT_ALL,
+};
+
+/**
+ * pseudo-legal moves of color `clr`, color and type
+ * are resolved at compile time
+ */
+template<Color clr, GenType type>
+void generate(const Board& b, MoveList& out, const AttackInfo* ai = nullptr);
+
+/* pseudo-legal moves of the side to move, dispatch once to generate<> */
+void generate_pseudo_moves(MoveList &out, const Board& b, GenType type=GT_ALL);
+/**
+ * only moves that do not leave own king in check,
+ * pins and checkers are computed once for the whole position
+ */
+void generate_legal_moves(MoveList &out, const Board& b, GenType type=GT_ALL);
+/* same, reading pins, checkers and attacked squares from the node's `ai` */
+void generate_legal_moves(MoveList &out, const Board& b, GenType type, const AttackInfo& ai);
 void enumerate_attacks(MoveList &out, Board& b, Color to_move);
-void generate_check_evading_moves(MoveList &out, Board& b);
 
 /**
  * pawn_attacks: also return pseudo-capture of pawn on empty square
@@ -25,9 +51,10 @@ void find_move_to_position(
     Board& b, const Pos& pos, MoveList& moveList,
     Color clr, int16_t max_move, bool only_takes);
 
-std::string move_to_string(const Move& m);
+std::string move_to_string(const Board& b, Move m);
 std::string move_to_uci_string(const Move& m);
-std::string move_to_string_disambiguate(Board& b, const Move& m);
+std::string move_to_string_disambiguate(Board& b, Move m);
+bool has_legal_move(const Board& b);
 
 
 void generate_king_move(const Board& b, const Pos& pos, Color clr,
@@ -49,7 +76,11 @@ void generate_pawn_move(
     Board& b, const Pos& pos, Color clr,
     MoveList& moveList, bool only_takes);
 
-void generate_castle_move(const Board& b, const Pos& pos, Color clr, MoveList& moveList);
+/* castling path attacks are read from `ai` when given */
+bool can_castle(const Board& b, Color clr, bool king_side, const AttackInfo* ai = nullptr);
+void generate_castle_move(
+    const Board& b, const Pos& pos, Color clr, MoveList& moveList,
+    const AttackInfo* ai = nullptr);
 
 std::string pos_to_square_name(const Pos& p);
 Pos square_name_to_pos(const std::string& squarename);
@@ -5,237 +5,361 @@
 #include "./move_generation.hpp"
 #include "./move_ordering.hpp"
 #include "./evaluation.hpp"
-#include "./engine.hpp"
+#include "./attacks.hpp"
 
 
+inline int32_t mvv_lva_value(const Board& b, Move m)
+{
+    return piece_value(captured_piece(b, m)) * 100 - piece_value(moved_piece(b, m));
+}
+
 void reorder_mvv_lva(
-    MoveList& moveList,
+    Board& b, MoveList& moveList,
     size_t begin, size_t end)
 {
-    for (auto& m : moveList)
-    {
-        m.mvv_lva_value = piece_value(m.taken_piece) * 100 - piece_value(m.piece);
-    }
-    std::sort(
-        moveList.begin() + begin,
-        moveList.begin() + end,
-        // moveList.begin(),
-        // moveList.end(),
-        [](const auto& a, const auto& b) {
-            return a.mvv_lva_value > b.mvv_lva_value;
-        });
+    for (auto i = begin; i < end; ++i) {
+        moveList.score(i) = mvv_lva_value(b, moveList[i]);
+    }
+    moveList.sort(begin, end);
 }
 
-void reorder_see(Board &b, MoveList &moveList, size_t begin, size_t end)
+void reorder_see(const Board& b, MoveList& moveList, size_t begin, size_t end)
 {
     for (auto i = begin; i < end; ++i) {
-       auto& m = moveList[i];
-       if (m.takes) {
-           m.see_value = see_capture(b, m);
-           m.mvv_lva_value = piece_value(m.taken_piece) * 100 - piece_value(m.piece);
+       Move m = moveList[i];
+       if (is_capture(b, m)) {
+           int32_t see_value = std::clamp(see_capture(b, m), -9000, 9000);
+           moveList.score(i) = see_value * 100000 + mvv_lva_value(b, m);
        }
        else {
-           m.see_value = 0;
+           moveList.score(i) = 0;
        }
     }
-
-    std::sort(
-        moveList.begin() + begin,
-        moveList.begin() + end,
-        [](const auto& a, const auto& b) {
-            if (a.see_value == b.see_value) {
-                return a.mvv_lva_value > b.mvv_lva_value;
-            }
-            return a.see_value > b.see_value;
-        });
+    moveList.sort(begin, end);
 }
 
-void reorder_moves(
-    NegamaxEngine &engine,
-    Board &b, MoveList &moveList, int ply, int remaining_depth,
-    KillerMoves &killers, bool has_hash_move, const Move &hash_move,
-    const HistoryMoves &history)
+/**
+ * least valuable piece among `attackers`, removed from `occupied`
+ */
+static Piece pop_least_valuable(const Board& b, Bitboard attackers, Bitboard& occupied)
 {
-    size_t offset = 0;
-
-    auto size = moveList.size();
-
-    // if (!has_hash_move && remaining_depth > 4) {
-    //     // INTERNAL ITERATIVE DEEPENING
-    //     Color clr = b.get_next_move();
-    //     int color = clr == C_WHITE ? +1 : -1;
-
-    //     //NegamaxEngine engine;
-    //     //engine.set_max_depth(2);
-    //     NodeType children = NodeType::PV_NODE;
-    //     MoveList pvLine;
-    //     for (auto &move : moveList) {
-    //         int max_depth = std::max((remaining_depth-1)/3, 2);
-    //         b.make_move(move);
-    //         if (b.is_king_checked(clr)) {
-    //             move.legal_checked = true;
-    //             move.legal = false;
-    //             b.unmake_move(move);
-    //             move.evaluation = -999999;
-    //             continue;
-    //         }
-    //         for (int depth = 1; depth <= max_depth; ++depth) {
-    //             move.evaluation = - engine.negamax(
-    //                 b, depth, depth, 0, color,
-    //                 -999999, // alpha
-    //                 +999999, // beta
-    //                 true,
-    //                 children,
-    //                 pvLine
-    //             );
-    //         }
-    //         b.unmake_move(move);
-    //     }
-    //     std::sort(
-    //         moveList.begin(),
-    //         moveList.end(),
-    //         [](const auto &m1, const auto &m2){
-    //             return m1.evaluation > m2.evaluation;
-    //         });
-    //     return;
-    // }
-    if (ply < killers.size() && killers[ply].size() > 0) {
-        auto& mykillers = killers[ply];
-        for (const auto& killer : mykillers) {
-            for (size_t i = 0; i < size; ++i) {
-                if (moveList[i] == killer) {
-                    moveList[i].killer = true;
-                    if (killer.mate_killer) {
-                        moveList[i].mate_killer = true;
-                    }
-                    break;
-                }
-            }
+    for (Piece p : { P_PAWN, P_KNIGHT, P_BISHOP, P_ROOK, P_QUEEN, P_KING }) {
+        Bitboard bb = attackers & b.get_pieces(p);
+        if (bb) {
+            occupied ^= bb & (0 - bb);
+            return p;
         }
     }
+    return P_EMPTY;
+}
 
-    if (ply >= 2 && ply < killers.size() && killers[ply-2].size() > 0) {
-        Move& killer = killers[ply-2][0];
-        for (size_t i = 0; i < size; ++i) {
-            if (moveList[i] == killer) {
-                moveList[i].killer = true;
-                if (killer.mate_killer) {
-                    moveList[i].mate_killer = true;
-                }
-                break;
-            }
+/**
+ * sliders of both colors behind the piece just removed from `occupied`
+ * now attack `sq`, captured pieces are dropped from `attackers`
+ */
+static Bitboard update_xrays(
+    const Board& b, uint8_t sq, Piece removed,
+    Bitboard attackers, Bitboard occupied)
+{
+    const Bitboard queens = b.get_pieces(P_QUEEN);
+    if (removed == P_PAWN || removed == P_BISHOP || removed == P_QUEEN) {
+        attackers |= bishop_attacks(sq, occupied) & (b.get_pieces(P_BISHOP) | queens);
+    }
+    if (removed == P_ROOK || removed == P_QUEEN) {
+        attackers |= rook_attacks(sq, occupied) & (b.get_pieces(P_ROOK) | queens);
+    }
+    return attackers & occupied;
+}
+
+/* occupancy once `m` is played, the en passant victim is not on dst */
+static Bitboard occupied_after(const Board& b, Move m)
+{
+    Bitboard occupied = b.get_occupied() ^ square_bb(m.src_sq());
+    if (m.is_en_passant()) {
+        occupied ^= square_bb((m.src_sq() & ~7) | (m.dst_sq() & 7));
+    }
+    return occupied;
+}
+
+/**
+ * SEE: Static Exchange Evaluation, with a swap list
+ * each side recaptures with its least valuable attacker
+ * and may stop when going on would lose material
+ * pins are ignored, the board is not modified
+ */
+int32_t see_capture(const Board& b, Move m)
+{
+    constexpr int MAX_SWAPS = 32;
+    int32_t gain[MAX_SWAPS];
+    const uint8_t sq = m.dst_sq();
+
+    Piece on_square = moved_piece(b, m);
+    gain[0] = piece_value(captured_piece(b, m));
+    if (m.is_promote()) {
+        on_square = m.promote_piece();
+        gain[0] += piece_value(on_square) - piece_value(P_PAWN);
+    }
+
+    Bitboard occupied = occupied_after(b, m);
+    Bitboard attackers = b.attackers_to(sq, occupied) & occupied;
+    Color side = other_color(b.get_next_move());
+    int depth = 0;
+    while (depth + 1 < MAX_SWAPS) {
+        Bitboard ours = attackers & b.get_color_pieces(side);
+        if (!ours) {
+            break;
         }
+        ++depth;
+        // score if the piece on the square is taken and nothing follows
+        gain[depth] = piece_value(on_square) - gain[depth - 1];
+        on_square = pop_least_valuable(b, ours, occupied);
+        attackers = update_xrays(b, sq, on_square, attackers, occupied);
+        side = other_color(side);
+    }
+    // each side picks between stopping and capturing
+    while (depth > 0) {
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+        --depth;
+    }
+    return gain[0];
+}
+
+/**
+ * whether see_capture(b, m) >= threshold, stops as soon as
+ * the side to move of the exchange cannot change the outcome
+ */
+bool see_ge(const Board& b, Move m, int32_t threshold)
+{
+    if (m.is_castling()) {
+        return threshold <= 0;
+    }
+    const uint8_t sq = m.dst_sq();
+
+    Piece on_square = moved_piece(b, m);
+    int32_t swap = piece_value(captured_piece(b, m)) - threshold;
+    if (m.is_promote()) {
+        on_square = m.promote_piece();
+        swap += piece_value(on_square) - piece_value(P_PAWN);
+    }
+    if (swap < 0) {
+        return false; // even keeping the piece falls short
+    }
+    swap = piece_value(on_square) - swap;
+    if (swap <= 0) {
+        return true; // even losing the piece is enough
     }
 
-    for (auto i = offset; i < size; ++i) {
-        auto& m = moveList[i];
-        m.mvv_lva_value = piece_value(m.taken_piece) * 100 - piece_value(m.piece);
-        if (m.takes) {
-            m.see_value = see_capture(b, m);
+    Bitboard occupied = occupied_after(b, m);
+    Bitboard attackers = b.attackers_to(sq, occupied) & occupied;
+    Color side = b.get_next_move();
+    bool result = true;
+    while (true) {
+        side = other_color(side);
+        Bitboard ours = attackers & b.get_color_pieces(side);
+        if (!ours) {
+            break;
+        }
+        result = !result;
+        Piece p = pop_least_valuable(b, ours, occupied);
+        if (p == P_KING) {
+            // the king may only take when nothing defends the square
+            return (attackers & b.get_color_pieces(other_color(side))) ? !result : result;
         }
-        else {
-            m.see_value = 0;
+        swap = piece_value(p) - swap;
+        if (swap < (int32_t)result) {
+            break;
         }
+        attackers = update_xrays(b, sq, p, attackers, occupied);
     }
+    return result;
+}
 
-    std::sort(
-        moveList.begin(), moveList.end(),
-        [&history](auto& a, auto& b) {
-            if (a.see_value > b.see_value) {
-                // good captures first
-                return true;
-            }
-            if (a.see_value < b.see_value) {
-                // bad captures lasts
-                return false;
-            }
-            if (a.killer && !b.killer) {
-                // killer after good captures
-                return true;
-            }
-            if (!a.killer && b.killer) {
-                // killer after good captures
-                return false;
-            }
-            if (a.mate_killer && !b.mate_killer) {
-                // mate killer before killers
-                return true;
-            }
-            if (!a.mate_killer && b.mate_killer) {
-                // mate killer before killers
-                return false;
+/**
+ * false when nothing of the opponent attacks the destination, even
+ * through the square left by the capturing piece (enemy slider on
+ * the line is assumed to x-ray)
+ */
+static bool may_be_recaptured(const Board& b, const AttackInfo& ai, Move m)
+{
+    const Color them = other_color(b.get_next_move());
+    const Bitboard sliders = b.get_pieces(them, P_BISHOP)
+        | b.get_pieces(them, P_ROOK) | b.get_pieces(them, P_QUEEN);
+    return ai.is_attacked(m.dst_sq(), them)
+        || (line_bb(m.src_sq(), m.dst_sq()) & sliders) != 0;
+}
+
+MovePicker::MovePicker(
+    Board& b, const AttackInfo& ai, Move hash_move,
+    const KillerMoves& killers, size_t ply,
+    Move counter_move, const HistoryMoves& history):
+    m_board{ b },
+    m_attacks{ ai },
+    m_history{ history },
+    m_stage{ Stage::HASH_MOVE },
+    m_hash_move{ hash_move },
+    m_index{ 0 },
+    m_bad_end{ 0 },
+    m_num_refutations{ 0 },
+    m_num_yielded_refutations{ 0 }
+{
+    // mate killers before killers, then the oldest killer of 2 plies before
+    if (ply < killers.size()) {
+        for (const auto& killer : killers[ply]) {
+            if (killer.mate) {
+                add_refutation(killer.move, MATE_KILLER_SCORE);
             }
-            // rest is ordered by history heuristic
-            auto idx1 = a.color*64*64+a.src.to_val()*64+a.dst.to_val();
-            auto idx2 = b.color*64*64+b.src.to_val()*64+b.dst.to_val();
-            auto h1 = history[idx1];
-            auto h2 = history[idx2];
-            if (h1 == h2) {
-                return a.mvv_lva_value > b.mvv_lva_value;
+        }
+        for (const auto& killer : killers[ply]) {
+            if (!killer.mate) {
+                add_refutation(killer.move, KILLER_SCORE);
             }
-            return h1 > h2;
         }
-    );
+        if (ply >= 2) {
+            const Killer& killer = killers[ply - 2][0];
+            add_refutation(killer.move, killer.mate ? MATE_KILLER_SCORE : KILLER_SCORE);
+        }
+    }
+    add_refutation(counter_move, COUNTER_MOVE_SCORE);
 }
 
-bool get_smallest_attacker(Board& b, const Pos &dst, Move& move)
+void MovePicker::add_refutation(Move m, int32_t score)
 {
-    MoveList moveList;
-    int32_t value = 0;
-    Color clr = b.get_next_move();
-    find_move_to_position(b, dst, moveList, clr , -1, true);
-    if (moveList.size() > 0)
-    {
-        int32_t min_piece_value = 999999;
-        bool found = false;
-        for (auto& candidate : moveList) {
-            // // check legality here ?
-            // b.make_move(candidate);
-            // candidate.legal_checked = true;
-            // candidate.legal = !b.is_king_checked(clr);
-            // b.unmake_move(candidate);
-            // if (!candidate.legal) { continue; }
-            int32_t value = piece_value(candidate.piece);
-            if (value < min_piece_value) {
-                min_piece_value = value;
-                move = candidate;
-                found = true;
-            }
+    if (m.is_none() || m == m_hash_move) {
+        return;
+    }
+    for (size_t i = 0; i < m_num_refutations; ++i) {
+        if (m_refutations[i] == m) {
+            return;
         }
-        return found;
     }
-    return false;
+    m_refutations[m_num_refutations] = m;
+    m_refutation_scores[m_num_refutations] = score;
+    ++m_num_refutations;
 }
 
-int32_t compute_see(Board &b, const Pos& dst)
+bool MovePicker::was_yielded_refutation(Move m) const
 {
-    Piece p = b.get_piece_at(dst);
-    if (p == P_EMPTY)
-    {
-        return 0;
-    }
-    int32_t value = 0;
-
-    // find enemy move
-    Move move;
-    bool found = get_smallest_attacker(b, dst, move);
-    if (found) {
-        int32_t just_captured = piece_value(move.taken_piece);
-        b.make_move(move);
-        value = std::max(0, just_captured - compute_see(b, dst));
-        b.unmake_move(move);
-    } // if not found means there is no takes to this square
-    return value;
+    for (size_t i = 0; i < m_num_yielded_refutations; ++i) {
+        if (m_yielded_refutations[i] == m) {
+            return true;
+        }
+    }
+    return false;
 }
 
-/**
- * SEE: Static Exchange Evaluation
- */
-int32_t see_capture(Board &b, const Move &capture)
+bool MovePicker::next(Move& move, int32_t& order_score)
 {
-    int32_t value = 0;
-    b.make_move(capture);
-    value = piece_value(capture.taken_piece) - compute_see(b, capture.dst);
-    b.unmake_move(capture);
-    return value;
+    Board& b = m_board;
+    switch (m_stage) {
+    case Stage::HASH_MOVE:
+        m_stage = Stage::GEN_CAPTURES;
+        if (!m_hash_move.is_none()) {
+            move = m_hash_move;
+            order_score = HASH_MOVE_SCORE;
+            return true;
+        }
+        [[fallthrough]];
+
+    case Stage::GEN_CAPTURES:
+        generate_legal_moves(m_captures, b, GT_CAPTURES, m_attacks);
+        reorder_mvv_lva(b, m_captures, 0, m_captures.size());
+        m_index = 0;
+        m_stage = Stage::GOOD_CAPTURES;
+        [[fallthrough]];
+
+    case Stage::GOOD_CAPTURES:
+        while (m_index < m_captures.size()) {
+            Move m = m_captures[m_index];
+            int32_t mvv_lva = m_captures.score(m_index);
+            ++m_index;
+            if (m == m_hash_move) {
+                continue;
+            }
+            // taking a piece at least as valuable, or an undefended one,
+            // cannot lose material; the exchange value is computed once
+            // and kept as the bad capture score
+            if (piece_value(captured_piece(b, m)) < piece_value(moved_piece(b, m))
+                && may_be_recaptured(b, m_attacks, m)) {
+                int32_t see_value = see_capture(b, m);
+                if (see_value < 0) {
+                    see_value = std::max(see_value, -9000);
+                    m_captures[m_bad_end] = m;
+                    m_captures.score(m_bad_end) = BAD_CAPTURE_SCORE + see_value * 1000 + mvv_lva;
+                    ++m_bad_end;
+                    continue;
+                }
+            }
+            move = m;
+            order_score = GOOD_CAPTURE_SCORE + mvv_lva;
+            return true;
+        }
+        m_index = 0;
+        m_stage = Stage::REFUTATIONS;
+        [[fallthrough]];
+
+    case Stage::REFUTATIONS:
+        while (m_index < m_num_refutations) {
+            Move m = m_refutations[m_index];
+            int32_t score = m_refutation_scores[m_index];
+            ++m_index;
+            // captures were already yielded with the captures
+            if (is_capture(b, m)) {
+                continue;
+            }
+            if (b.is_pseudo_legal(m) && b.is_legal(m, m_attacks.pinned, m_attacks.checkers)) {
+                m_yielded_refutations[m_num_yielded_refutations++] = m;
+                move = m;
+                order_score = score;
+                return true;
+            }
+        }
+        m_stage = Stage::GEN_QUIETS;
+        [[fallthrough]];
+
+    case Stage::GEN_QUIETS:
+    {
+        generate_legal_moves(m_quiets, b, GT_QUIETS, m_attacks);
+        const Color clr = b.get_next_move();
+        for (size_t i = 0; i < m_quiets.size(); ++i) {
+            Move m = m_quiets[i];
+            auto idx = clr * 64 * 64 + m.src_sq() * 64 + m.dst_sq();
+            m_quiets.score(i) = (int32_t)std::min<uint64_t>(m_history[idx], MAX_HISTORY_SCORE);
+        }
+        m_quiets.sort();
+        m_index = 0;
+        m_stage = Stage::QUIETS;
+    }
+        [[fallthrough]];
+
+    case Stage::QUIETS:
+        while (m_index < m_quiets.size()) {
+            Move m = m_quiets[m_index];
+            int32_t score = m_quiets.score(m_index);
+            ++m_index;
+            if (m == m_hash_move || was_yielded_refutation(m)) {
+                continue;
+            }
+            move = m;
+            order_score = score;
+            return true;
+        }
+        m_captures.sort(0, m_bad_end);
+        m_index = 0;
+        m_stage = Stage::BAD_CAPTURES;
+        [[fallthrough]];
+
+    case Stage::BAD_CAPTURES:
+        if (m_index < m_bad_end) {
+            move = m_captures[m_index];
+            order_score = m_captures.score(m_index);
+            ++m_index;
+            return true;
+        }
+        m_stage = Stage::DONE;
+        [[fallthrough]];
+
+    case Stage::DONE:
+        break;
+    }
+    return false;
 }
@@ -5,15 +5,81 @@
 
 #include "./board.hpp"
 #include "./move.hpp"
+#include "./attack_info.hpp"
 
-struct NegamaxEngine;
 
-void reorder_mvv_lva(MoveList& moveList, size_t begin, size_t end);
-void reorder_moves(
-    NegamaxEngine &engine,
-    Board &b, MoveList &moveList , int current_depth, int remaining_depth,
-    KillerMoves &killers, bool has_hash_move, const Move &hash_move, const HistoryMoves &history);
-void reorder_see(Board& b, MoveList& moveList, size_t begin, size_t end);
-int32_t see_capture(Board &b, const Move &m);
+/**
+ * ordering score bands, from first to last searched:
+ * hash move, captures not losing material (by MVV-LVA), mate killers,
+ * killers, counter move, quiet moves (by history), losing captures (by SEE)
+ */
+constexpr int32_t HASH_MOVE_SCORE = 2000000000;
+constexpr int32_t GOOD_CAPTURE_SCORE = 1000000000;
+constexpr int32_t MATE_KILLER_SCORE = 900000000;
+constexpr int32_t KILLER_SCORE = 800000000;
+constexpr int32_t COUNTER_MOVE_SCORE = 700000000;
+constexpr int32_t MAX_HISTORY_SCORE = 500000000;
+constexpr int32_t BAD_CAPTURE_SCORE = -1000000000;
+
+void reorder_mvv_lva(Board& b, MoveList& moveList, size_t begin, size_t end);
+void reorder_see(const Board& b, MoveList& moveList, size_t begin, size_t end);
+/* material won by `m` once all exchanges on its destination are played out */
+int32_t see_capture(const Board& b, Move m);
+/* see_capture(b, m) >= threshold, usually without computing it entirely */
+bool see_ge(const Board& b, Move m, int32_t threshold);
+
+/**
+ * yields the legal moves of a node in stages, each stage being
+ * generated and sorted only when reached, so that an early cutoff
+ * skips most of the work
+ */
+class MovePicker
+{
+public:
+    /* `hash_move` must be legal or none, `ai` computed for `b` */
+    MovePicker(
+        Board& b, const AttackInfo& ai, Move hash_move,
+        const KillerMoves& killers, size_t ply,
+        Move counter_move, const HistoryMoves& history);
+
+    /* next move to search and its score band, false once all were yielded */
+    bool next(Move& move, int32_t& order_score);
+
+    /* moves generated so far, every legal move once quiets are reached */
+    size_t num_generated() const { return m_captures.size() + m_quiets.size(); }
+
+private:
+    enum class Stage : uint8_t {
+        HASH_MOVE,
+        GEN_CAPTURES,
+        GOOD_CAPTURES,
+        REFUTATIONS, // killers and counter move
+        GEN_QUIETS,
+        QUIETS,
+        BAD_CAPTURES,
+        DONE,
+    };
+    static constexpr size_t MAX_REFUTATIONS = NUM_KILLERS + 2;
+
+    Board& m_board;
+    const AttackInfo& m_attacks;
+    const HistoryMoves& m_history;
+    Stage m_stage;
+    Move m_hash_move;
+
+    MoveList m_captures;
+    MoveList m_quiets;
+    size_t m_index;
+    size_t m_bad_end; // losing captures are moved to the front of m_captures
+
+    Move m_refutations[MAX_REFUTATIONS];
+    int32_t m_refutation_scores[MAX_REFUTATIONS];
+    size_t m_num_refutations;
+    Move m_yielded_refutations[MAX_REFUTATIONS];
+    size_t m_num_yielded_refutations;
+
+    void add_refutation(Move m, int32_t score);
+    bool was_yielded_refutation(Move m) const;
+};
 
 #endif // CHESS_MOVE_ORDERING_H
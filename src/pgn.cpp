@@ -72,34 +72,35 @@ void find_optional_src(const std::string &san, Pos &src)
     }
 }
 
-void find_move_src_for_attacking_piece(Board &b, Move &move)
+void find_move_src_for_attacking_piece(
+    Board &b, Piece piece, Color clr, const Pos& dst, Pos& src)
 {
-    if (move.src.row != 0xFF && move.src.column != 0xFF)
+    if (src.row != 0xFF && src.column != 0xFF)
     {
         return;
     }
     MoveList ml;
-    find_move_to_position(b, move.dst, ml, move.color, -1, false);
-    if (move.src.row != 0xFF)
+    find_move_to_position(b, dst, ml, clr, -1, false);
+    if (src.row != 0xFF)
     {
         // find on given row
-        for (auto& m : ml)
+        for (const auto& m : ml)
         {
-            if (m.src.row == move.src.row && m.piece == move.piece)
+            if (m.src().row == src.row && moved_piece(b, m) == piece)
             {
-                move.src.column = m.src.column;
+                src.column = m.src().column;
                 break;
             }
         }
     }
-    else if (move.src.column != 0xFF)
+    else if (src.column != 0xFF)
     {
         // find on given column
-        for (auto& m : ml)
+        for (const auto& m : ml)
         {
-            if (m.src.column == move.src.column && m.piece == move.piece)
+            if (m.src().column == src.column && moved_piece(b, m) == piece)
             {
-                move.src.row = m.src.row;
+                src.row = m.src().row;
                 break;
             }
         }
@@ -107,11 +108,11 @@ void find_move_src_for_attacking_piece(Board &b, Move &move)
     else
     {
         // find among all move
-        for (auto& m : ml)
+        for (const auto& m : ml)
         {
-            if (m.piece == move.piece)
+            if (moved_piece(b, m) == piece)
             {
-                move.src = m.src;
+                src = m.src();
                 break;
             }
         }
@@ -144,9 +145,9 @@ Move compute_move_from_san(const std::string& san, Color clr, Board& b)
 
     char first_letter = san[0];
 
-    move.piece = get_piece_by_char_pgn(first_letter);
-
-    move.color = clr;
+    Piece piece = get_piece_by_char_pgn(first_letter);
+    Pos src;
+    Pos dst;
 
     size_t i = san.size();
 
@@ -165,32 +166,30 @@ Move compute_move_from_san(const std::string& san, Color clr, Board& b)
     {
         promote = P_EMPTY;
     }
-    move.promote = promote;
-    move.dst.row = san[i - 1] - '1';
-    move.dst.column = san[i - 2] - 'a';
+    dst.row = san[i - 1] - '1';
+    dst.column = san[i - 2] - 'a';
     i -= 2;
 
     if (i <= 1) {
-        find_optional_src("", move.src);
-        find_move_src_for_attacking_piece(b, move);
+        find_optional_src("", src);
+        find_move_src_for_attacking_piece(b, piece, clr, dst, src);
     }
     else if (i >= 2 && i <= 4 && san[i-1] == 'x') {
-        move.takes = 1;
-        move.taken_piece = b.get_piece_at(move.dst);
-        int begin = move.piece == P_PAWN ? 0 : 1;
+        int begin = piece == P_PAWN ? 0 : 1;
 
         std::string srcstr = san.substr(begin, i - 1 - begin);
-        find_optional_src(srcstr, move.src);
-        find_move_src_for_attacking_piece(b, move);
+        find_optional_src(srcstr, src);
+        find_move_src_for_attacking_piece(b, piece, clr, dst, src);
     }
     else {
-        int begin = move.piece == P_PAWN ? 0 : 1;
+        int begin = piece == P_PAWN ? 0 : 1;
 
         std::string srcstr = san.substr(begin, i-begin);
-        find_optional_src(srcstr, move.src);
-        find_move_src_for_attacking_piece(b, move);
+        find_optional_src(srcstr, src);
+        find_move_src_for_attacking_piece(b, piece, clr, dst, src);
     }
-    if (move.src.row == 0xFF || move.src.column == 0xFF)
+    if (src.row == 0xFF || src.column == 0xFF
+        || !generate_move_for_squares(b, src, dst, promote, move))
     {
         std::cout << "err\n";
     }
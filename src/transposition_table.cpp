@@ -1,7 +1,22 @@
 
-#include <vector>
-#include <random>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <Windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
 
 #include "fmt/format.h"
 
@@ -9,39 +24,344 @@
 #include "./board.hpp"
 #include "./move.hpp"
 
-uint64_t HashParams::piece[HASH_PARAM_SIZE];
+/**
+ * xorshift64* sequence, evaluated by the compiler
+ * so the keys are read-only data with nothing to do at startup
+ */
+static constexpr std::array<uint64_t, HASH_PARAM_SIZE> generate_hash_params()
+{
+    std::array<uint64_t, HASH_PARAM_SIZE> keys{};
+    uint64_t s = HASH_PARAMS_SEED;
+    for (auto& key : keys) {
+        s ^= s >> 12;
+        s ^= s << 25;
+        s ^= s >> 27;
+        key = s * 2685821657736338717_u64;
+    }
+    return keys;
+}
+
+constinit const std::array<uint64_t, HASH_PARAM_SIZE> HashParams::piece = generate_hash_params();
+
+static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+
+#if defined(__linux__)
+/**
+ * bytes of transparent huge pages backing the mapping at `addr`,
+ * read from the AnonHugePages line of its /proc/self/smaps entry
+ */
+static size_t transparent_huge_bytes(const void* addr)
+{
+    std::ifstream smaps("/proc/self/smaps");
+    const uintptr_t target = (uintptr_t)addr;
+    bool in_mapping = false;
+    std::string line;
+    while (std::getline(smaps, line)) {
+        uintptr_t start, end;
+        if (std::sscanf(line.c_str(), "%" SCNxPTR "-%" SCNxPTR, &start, &end) == 2
+            && line.find(':') > line.find(' ')) {
+            in_mapping = start <= target && target < end;
+        }
+        else if (in_mapping && line.rfind("AnonHugePages:", 0) == 0) {
+            return (size_t)std::stoull(line.substr(14)) << 10;
+        }
+    }
+    return 0;
+}
+#endif
+
+/**
+ * explicit huge pages if some are reserved, else regular pages
+ * aligned on huge page boundaries with transparent huge pages asked for
+ */
+static void* map_table_memory(size_t bytes, TablePages& pages)
+{
+#if defined(__linux__)
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        pages = TablePages::HUGE;
+        return p;
+    }
+#endif
+#if defined(_WIN32)
+    pages = TablePages::SMALL;
+    return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    // over-map then trim so that the start is huge page aligned
+    const size_t padded = bytes + HUGE_PAGE_SIZE;
+    char* raw = (char*)mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == (char*)MAP_FAILED) {
+        return nullptr;
+    }
+    char* aligned = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (aligned != raw) {
+        munmap(raw, aligned - raw);
+    }
+    munmap(aligned + bytes, (raw + padded) - (aligned + bytes));
+    pages = TablePages::SMALL;
+#if defined(MADV_HUGEPAGE)
+    if (madvise(aligned, bytes, MADV_HUGEPAGE) == 0) {
+        pages = TablePages::TRANSPARENT_HUGE;
+    }
+#endif
+    return aligned;
+#endif
+}
+
+void TranspositionTable::release()
+{
+    if (m_buckets == nullptr) {
+        return;
+    }
+#if defined(_WIN32)
+    VirtualFree(m_buckets, 0, MEM_RELEASE);
+#else
+    munmap(m_buckets, m_mapped_bytes);
+#endif
+    m_buckets = nullptr;
+    m_num_buckets = 0;
+    m_mapped_bytes = 0;
+}
 
-void HashParams::init_params()
+void TranspositionTable::init(size_t size_mb)
 {
-    constexpr uint64_t seed = u64(15925555970513767049UL);
-    std::mt19937_64 gen64{ seed };
-    std::uniform_int_distribution<uint64_t> rand{ 0, std::numeric_limits<uint64_t>::max() };
-    std::cout << "rand1=" << rand(gen64) << "\n";
-    std::cout << "rand2=" << rand(gen64) << "\n";
-    std::cout << "rand3=" << rand(gen64) << "\n";
-    std::cout << "seed1=" << seed << "\n";
+    size_mb = std::clamp(size_mb, MIN_SIZE_MB, MAX_SIZE_MB);
+    size_t n = (size_mb << 20) / sizeof(HashBucket);
+    if (n != m_num_buckets) {
+        // map before releasing so a failure keeps the current table,
+        // the new pages are only faulted in by clear() once the old are gone
+        size_t bytes = (n * sizeof(HashBucket) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        TablePages pages;
+        HashBucket* buckets = (HashBucket*)map_table_memory(bytes, pages);
+        if (buckets == nullptr) {
+            throw chess_exception(fmt::format("cannot map {} MB for the hash table", size_mb));
+        }
+        release();
+        m_buckets = buckets;
+        m_pages = pages;
+        m_num_buckets = n;
+        m_mapped_bytes = bytes;
+    }
+    // fresh pages are already zero, this faults them in in parallel
+    clear();
+}
 
-    for (int s = 0; s < HASH_PARAM_SIZE; ++s) {
-        HashParams::piece[s] = rand(gen64);
+uint32_t TranspositionTable::hashfull() const
+{
+    const size_t sampled = std::min<size_t>(1000, m_num_buckets);
+    size_t used = 0;
+    for (size_t i = 0; i < sampled; ++i) {
+        for (const HashSlot& s : m_buckets[i].slots) {
+            HashEntry e = s.load();
+            used += !e.is_empty() && e.generation() == m_generation;
+        }
     }
-    //for (int s = 0; s < NUM_SQUARE; ++s) {
-    //    for (int p = 0; p < NUM_PIECE; ++p) {
-    //        std::cout << "data=" << HashParams::piece[s * NUM_PIECE + p] << "\n";
-    //    }
-    //}
+    return (uint32_t)(used * 1000 / std::max<size_t>(sampled * HASH_BUCKET_ENTRIES, 1));
+}
+
+std::string TranspositionTable::memory_description() const
+{
+    switch (m_pages) {
+    case TablePages::HUGE:
+        return fmt::format("{} MB on explicit huge pages", size_in_bytes() >> 20);
+    case TablePages::TRANSPARENT_HUGE:
+    {
+#if defined(__linux__)
+        size_t huge = transparent_huge_bytes(m_buckets);
+        return fmt::format("{} MB, {} MB on transparent huge pages",
+                           size_in_bytes() >> 20, std::min(huge, size_in_bytes()) >> 20);
+#else
+        return fmt::format("{} MB, transparent huge pages requested", size_in_bytes() >> 20);
+#endif
+    }
+    default:
+        return fmt::format("{} MB, no huge pages", size_in_bytes() >> 20);
+    }
+}
+
+/**
+ * split [0, num_buckets) in one chunk per thread and run
+ * `work(begin, end)` on each, big tables take seconds on one core
+ */
+template<typename F>
+static void for_each_chunk(size_t num_buckets, F&& work)
+{
+    // below this each thread would cost more to start than it saves
+    constexpr size_t MIN_BYTES_PER_THREAD = 32 << 20;
+    const size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t num_threads = std::clamp<size_t>(
+        num_buckets * sizeof(HashBucket) / MIN_BYTES_PER_THREAD, 1, max_threads);
+    const size_t chunk = (num_buckets + num_threads - 1) / num_threads;
+
+    auto run_chunk = [&work, chunk, num_buckets](size_t i) {
+        size_t begin = std::min(i * chunk, num_buckets);
+        work(begin, std::min(begin + chunk, num_buckets));
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(run_chunk, i);
+    }
+    run_chunk(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void TranspositionTable::save(const std::string& path) const
+{
+    HashFileHeader header{};
+    std::memcpy(header.magic, HashFileHeader::MAGIC, sizeof header.magic);
+    header.version = HashFileHeader::VERSION;
+    header.bucket_size = sizeof(HashBucket);
+    header.zobrist_seed = HASH_PARAMS_SEED;
+    header.num_buckets = m_num_buckets;
+    header.generation = m_generation;
+
+    std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+    file.write((const char*)&header, sizeof header);
+    file.write((const char*)m_buckets, (std::streamsize)size_in_bytes());
+    if (!file) {
+        throw chess_exception(fmt::format("cannot write hash file '{}'", path));
+    }
+}
+
+/**
+ * the file is mapped read-only and copied into the table by all
+ * threads, pages come straight from the page cache after a restart
+ */
+void TranspositionTable::load(const std::string& path)
+{
+#if defined(_WIN32)
+    std::ifstream file{ path, std::ios::binary | std::ios::ate };
+    const size_t file_size = (size_t)file.tellg();
+    file.seekg(0);
+    HashFileHeader header{};
+    file.read((char*)&header, sizeof header);
+    if (!file) {
+        throw chess_exception(fmt::format("cannot read hash file '{}'", path));
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(HashFileHeader)) {
+        if (fd >= 0) { close(fd); }
+        throw chess_exception(fmt::format("cannot read hash file '{}'", path));
+    }
+    const size_t file_size = (size_t)st.st_size;
+    const char* data = (const char*)mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == (const char*)MAP_FAILED) {
+        throw chess_exception(fmt::format("cannot map hash file '{}'", path));
+    }
+    madvise((void*)data, file_size, MADV_SEQUENTIAL);
+    HashFileHeader header;
+    std::memcpy(&header, data, sizeof header);
+#endif
+
+    const char* error = nullptr;
+    if (std::memcmp(header.magic, HashFileHeader::MAGIC, sizeof header.magic) != 0) {
+        error = "not a hash file";
+    } else if (header.version != HashFileHeader::VERSION || header.bucket_size != sizeof(HashBucket)) {
+        error = "entry layout differs";
+    } else if (header.zobrist_seed != HASH_PARAMS_SEED) {
+        error = "zobrist keys differ";
+    } else if (header.num_buckets == 0 || header.num_buckets % ((1 << 20) / sizeof(HashBucket)) != 0
+               || header.num_buckets > (MAX_SIZE_MB << 20) / sizeof(HashBucket)
+               || file_size != sizeof header + header.num_buckets * sizeof(HashBucket)) {
+        error = "size is invalid";
+    }
+    if (error != nullptr) {
+#if !defined(_WIN32)
+        munmap((void*)data, file_size);
+#endif
+        throw chess_exception(fmt::format("cannot load hash file '{}': {}", path, error));
+    }
+
+    // clearing the table first also faults its pages in
+#if defined(_WIN32)
+    init((header.num_buckets * sizeof(HashBucket)) >> 20);
+#else
+    try {
+        init((header.num_buckets * sizeof(HashBucket)) >> 20);
+    }
+    catch (chess_exception&) {
+        munmap((void*)data, file_size);
+        throw;
+    }
+#endif
+    m_generation = header.generation;
+#if defined(_WIN32)
+    file.read((char*)m_buckets, (std::streamsize)size_in_bytes());
+    if (!file) {
+        throw chess_exception(fmt::format("cannot read hash file '{}'", path));
+    }
+#else
+    const HashBucket* saved = (const HashBucket*)(data + sizeof header);
+    for_each_chunk(m_num_buckets, [this, saved](size_t begin, size_t end) {
+        std::memcpy((void*)(m_buckets + begin), saved + begin, (end - begin) * sizeof(HashBucket));
+    });
+    munmap((void*)data, file_size);
+#endif
+}
+
+void TranspositionTable::clear()
+{
+    for_each_chunk(m_num_buckets, [this](size_t begin, size_t end) {
+        std::memset((void*)(m_buckets + begin), 0, (end - begin) * sizeof(HashBucket));
+    });
+}
+
+/**
+ * in eighths of a ply of depth: deeper entries save more work, an exact
+ * score is worth one more ply than a bound, a null window result half a
+ * ply less, each search since the entry was last used costs 8 plies
+ */
+static int32_t worth_keeping(const HashEntry& e, uint8_t generation)
+{
+    return e.depth * 8
+        + (e.is_bound() ? 0 : 8)
+        - (e.is_null_window() ? 4 : 0)
+        - 64 * e.age(generation);
+}
+
+bool TranspositionTable::probe(uint64_t key, HashEntry& entry, HashSlot*& slot)
+{
+    HashBucket& home = bucket(key);
+    int32_t replace_worth = INT32_MAX;
+    for (HashSlot& s : home.slots) {
+        HashEntry e = s.load();
+        if (e.matches(key)) {
+            if (e.generation() != m_generation) {
+                e.refresh(m_generation);
+                s.store(e);
+            }
+            entry = e;
+            slot = &s;
+            return true;
+        }
+        int32_t worth = e.is_empty() ? INT32_MIN : worth_keeping(e, m_generation);
+        if (worth < replace_worth) {
+            entry = e;
+            slot = &s;
+            replace_worth = worth;
+        }
+    }
+    return false;
 }
 
 uint64_t HashMethods::full_hash(const Board &b)
 {
     uint64_t hash = 0;
-    for (uint8_t s = 0; s < 64; ++s) {
+    Bitboard occupied = b.get_occupied();
+    while (occupied) {
+        uint8_t s = pop_lsb(occupied);
         Piece p = b.get_piece_at(s);
         Color c = b.get_color_at(s);
-        if (c != C_EMPTY) {
-            uint16_t p_idx = (s * NUM_PIECE) + (p - 1) + (6 * c);
-            //std::cout << "FULLHASH piece_idx=" << p_idx << "\n";
-            hash ^= HashParams::piece[PIECE_OFFSET + p_idx];
-        }
+        uint16_t p_idx = (s * NUM_PIECE) + (p - 1) + (6 * c);
+        //std::cout << "FULLHASH piece_idx=" << p_idx << "\n";
+        hash ^= HashParams::piece[PIECE_OFFSET + p_idx];
     }
     Pos ep_pos = b.get_en_passant_pos();
     if (ep_pos.row != 0) {
@@ -66,7 +386,7 @@ uint64_t HashMethods::full_hash(const Board &b)
  
     return hash;
 }
-void HashMethods::make_null_move(const Board &b, uint64_t& hash, const NullMove&)
+void HashMethods::make_null_move(const Board &b, uint64_t& hash)
 {
     // update side to move
     hash ^= HashParams::piece[SIDE_TO_MOVE_OFFSET];
@@ -79,14 +399,19 @@ void HashMethods::make_null_move(const Board &b, uint64_t& hash, const NullMove&
     }
 }
 
-void HashMethods::make_move(const Board& b, uint64_t &hash, const Move &m, uint8_t castle_diff)
+void HashMethods::make_move(const Board& b, uint64_t &hash, Move m, uint8_t castle_diff)
 {
+    const Pos src = m.src();
+    const Pos dst = m.dst();
+    const Piece piece = b.get_piece_at(src);
+    const Color color = b.get_color_at(src);
+
     // remove taken piece at dst
     {
-        Piece p = b.get_piece_at(m.dst);
-        Color c = b.get_color_at(m.dst);
+        Piece p = b.get_piece_at(dst);
+        Color c = b.get_color_at(dst);
         if (c != C_EMPTY) {
-            int sq = m.dst.to_val();
+            int sq = dst.to_val();
             auto ix = (sq * NUM_PIECE) + (p - 1) + (6 * c);
             hash ^= HashParams::piece[PIECE_OFFSET + ix];
         }
@@ -94,23 +419,23 @@ void HashMethods::make_move(const Board& b, uint64_t &hash, const Move &m, uint8
 
     // add moved piece at dst
     {
-        Piece p = m.promote ? m.promote_piece : m.piece;
-        Color c = m.color;
-        int sq = m.dst.to_val();
+        Piece p = m.is_promote() ? m.promote_piece() : piece;
+        Color c = color;
+        int sq = dst.to_val();
         auto ix = (sq * NUM_PIECE) + (p - 1) + (6 * c);
         hash ^= HashParams::piece[PIECE_OFFSET + ix];
     }
 
     // remove moved piece at src
     {
-        Piece p = b.get_piece_at(m.src);
-        Color c = b.get_color_at(m.src);
-        int sq = m.src.to_val();
+        Piece p = piece;
+        Color c = color;
+        int sq = src.to_val();
         auto ix = (sq * NUM_PIECE) + (p - 1) + (6 * c);
         hash ^= HashParams::piece[PIECE_OFFSET + ix];
     }
 
-    if (m.en_passant)
+    if (m.is_en_passant())
     {
         // remove en passant taken pawn
         Pos pos = b.get_en_passant_pos();
@@ -121,17 +446,17 @@ void HashMethods::make_move(const Board& b, uint64_t &hash, const Move &m, uint8
         hash ^= HashParams::piece[PIECE_OFFSET + ix];
     }
 
-    if (m.castling)
+    if (m.is_castling())
     {
-        uint8_t dstCol = m.dst.column;
-        uint8_t row = m.src.row;
+        uint8_t dstCol = dst.column;
+        uint8_t row = src.row;
         Pos rook_src{ row, u8(dstCol == 6 ? 7 : 0) };
         Pos rook_dst{ row, u8(dstCol == 6 ? 5 : 3) };
 
         {
             // add rook at dst
             Piece p = P_ROOK;
-            Color c = m.color;
+            Color c = color;
             int sq = rook_dst.to_val();
             auto ix = (sq * NUM_PIECE) + ((p - 1) + (6 * c));
             hash ^= HashParams::piece[PIECE_OFFSET + ix];
@@ -140,7 +465,7 @@ void HashMethods::make_move(const Board& b, uint64_t &hash, const Move &m, uint8
         {
             // remove rook at src
             Piece p = P_ROOK;
-            Color c = m.color;
+            Color c = color;
             int sq = rook_src.to_val();
             auto ix = (sq * NUM_PIECE) + ((p - 1) + (6 * c));
             hash ^= HashParams::piece[PIECE_OFFSET + ix];
@@ -155,10 +480,10 @@ void HashMethods::make_move(const Board& b, uint64_t &hash, const Move &m, uint8
     }
 
     // new state has en passant
-    if (m.piece == P_PAWN && std::abs(m.src.row-m.dst.row) == 2)
+    if (piece == P_PAWN && std::abs(src.row - dst.row) == 2)
     {
         // en passant file state add new state
-        hash ^= HashParams::piece[EN_PASSANT_OFFSET + m.dst.column];
+        hash ^= HashParams::piece[EN_PASSANT_OFFSET + dst.column];
     }
 
     // update side to move
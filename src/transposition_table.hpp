@@ -1,13 +1,22 @@
 #ifndef CHESS_TRANSPOSITION_TABLE_H
 #define CHESS_TRANSPOSITION_TABLE_H
 
-#include <unordered_map>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 #include "./types.hpp"
 
+#if defined(_MSC_VER)
+#   include <xmmintrin.h>
+#endif
+
 class Board;
 struct Move;
-struct NullMove;
 
 enum HashParamsValues {
     NUM_PIECE = 6+6, // 0->5 black pieces, 6-11 white pieces
@@ -31,95 +40,199 @@ enum HashParamsValues {
     ,
 
 };
+/* the zobrist keys are a fixed sequence generated from this seed */
+constexpr uint64_t HASH_PARAMS_SEED = 15925555970513767049_u64;
+
 struct HashParams
 {
-    static uint64_t piece[HASH_PARAM_SIZE];
-    static void init_params();
+    static const std::array<uint64_t, HASH_PARAM_SIZE> piece;
 };
 
-struct PerftHashEntry {
-    uint64_t key;
-    uint16_t depth;
-    uint64_t value;
-    uint64_t nummoves;
-    PerftHashEntry() :
-        key{ 0 },
-        depth{ 0 },
-        value{ 0 },
-        nummoves{ 0 }
-    {
+/**
+ * compact entry, 8 of them fill a cache line
+ * the upper 16 bits of the zobrist key tell positions apart
+ * within a bucket, the lower bits select the bucket
+ */
+struct HashEntry {
+    uint16_t key16;
+    uint16_t hash_move; // packed Move, 0 when none
+    int16_t score;
+    int8_t depth;
+    uint8_t flags; // node type in bits 0-2, null window in bit 3, generation in bits 4-7
+
+    static constexpr uint8_t NULL_WINDOW_FLAG = 0x08;
+    static constexpr int GENERATION_SHIFT = 4;
+    static constexpr uint8_t GENERATION_MASK = 0x0F;
+
+    static uint16_t key16_of(uint64_t key) { return (uint16_t)(key >> 48); }
+
+    NodeType node_type() const { return (NodeType)(flags & 0x07); }
+    bool is_null_window() const { return (flags & NULL_WINDOW_FLAG) != 0; }
+    uint8_t generation() const { return flags >> GENERATION_SHIFT; }
+    /* nothing is ever stored with an undefined node type */
+    bool is_empty() const { return node_type() == NodeType::UNDEFINED; }
+    bool matches(uint64_t key) const { return !is_empty() && key16 == key16_of(key); }
+    /* only a lower or upper bound of the score is known */
+    bool is_bound() const {
+        return node_type() == NodeType::CUT_NODE || node_type() == NodeType::ALL_NODE;
+    }
+    /* searches since this entry was stored or last found */
+    uint8_t age(uint8_t current_generation) const {
+        return (current_generation - generation()) & GENERATION_MASK;
+    }
+    void refresh(uint8_t gen) {
+        flags = (uint8_t)((flags & ~(GENERATION_MASK << GENERATION_SHIFT)) | (gen << GENERATION_SHIFT));
+    }
 
+    void save(
+        uint64_t key, uint16_t move, int32_t value, int32_t remaining_depth,
+        NodeType type, bool null_window, uint8_t gen)
+    {
+        key16 = key16_of(key);
+        hash_move = move;
+        score = (int16_t)std::clamp<int32_t>(value, -INT16_MAX, INT16_MAX);
+        depth = (int8_t)std::clamp<int32_t>(remaining_depth, INT8_MIN, INT8_MAX);
+        flags = (uint8_t)((uint8_t)type | (null_window ? NULL_WINDOW_FLAG : 0)
+                          | (gen << GENERATION_SHIFT));
     }
 };
-struct HashEntry {
-    uint64_t key;
-    uint16_t depth;
-    int32_t score;
-    int8_t hashmove_src;
-    int8_t hashmove_dst;
-    Piece promote_piece;
-
-    #ifdef CHESS_DEBUG
-    std::string fen;
-    #endif
-    NodeType node_type;
-    unsigned is_null_window : 1;
-
-    HashEntry() :
-        key{ 0 },
-        depth{ 0 },
-        score{ 0 },
-        hashmove_src{ 0 },
-        hashmove_dst{ 0 },
-        promote_piece{ Piece::P_EMPTY },
-        node_type{NodeType::UNDEFINED},
-        is_null_window { 0 }
-    {
+static_assert(sizeof(HashEntry) == 8, "HashEntry must stay packed in 8 bytes");
+
+/**
+ * one entry of the table, read and written as a single 64-bit atomic
+ * word: threads sharing the table never see half of another write,
+ * a lost race only costs a lost entry
+ */
+struct HashSlot {
+    uint64_t word;
+
+    HashEntry load() const {
+        // atomic_ref<const T> only comes with C++26
+        auto& w = const_cast<uint64_t&>(word);
+        return std::bit_cast<HashEntry>(std::atomic_ref<uint64_t>(w).load(std::memory_order_relaxed));
     }
+    void store(const HashEntry& e) {
+        std::atomic_ref<uint64_t>(word).store(std::bit_cast<uint64_t>(e), std::memory_order_relaxed);
+    }
+};
+static_assert(std::atomic_ref<uint64_t>::is_always_lock_free, "HashSlot needs lock-free 64-bit atomics");
+
+constexpr size_t HASH_BUCKET_ENTRIES = 8;
 
+struct alignas(64) HashBucket {
+    HashSlot slots[HASH_BUCKET_ENTRIES];
+};
+static_assert(sizeof(HashBucket) == 64, "a HashBucket must fill one cache line");
+
+/**
+ * start of a file written by TranspositionTable::save, followed by
+ * the raw buckets; a table is only valid with the same zobrist keys
+ * and entry layout
+ */
+struct HashFileHeader {
+    static constexpr char MAGIC[8] = { 'T', 'C', 'H', 'A', 'S', 'H', '\0', '\0' };
+    static constexpr uint32_t VERSION = 1; // bump when HashEntry or HashBucket change
+
+    char magic[8];
+    uint32_t version;
+    uint32_t bucket_size;
+    uint64_t zobrist_seed;
+    uint64_t num_buckets;
+    uint8_t generation;
+    uint8_t reserved[31];
+};
+static_assert(sizeof(HashFileHeader) == 64, "buckets follow the header aligned on a cache line");
+
+/* how the pages backing the table were obtained */
+enum class TablePages : uint8_t {
+    SMALL = 0,
+    TRANSPARENT_HUGE, // madvise(MADV_HUGEPAGE), the kernel may or may not comply
+    HUGE,             // mmap(MAP_HUGETLB) from the reserved huge page pool
 };
 
-template<typename E = HashEntry>
-struct Hash
+/**
+ * fixed size table of buckets: a key always lands in the same
+ * bucket, so a probe costs at most one cache miss
+ * storage is mapped once by init(), preferably on huge pages to save
+ * TLB misses, and faulted in by all threads so that neither lookups
+ * nor the first search pay for it
+ */
+class TranspositionTable
 {
 private:
-    std::unordered_map<uint64_t,E> m_entries;
-public:
-    Hash(){}
-
-    void init(size_t size)
-    {
-        m_entries.reserve(size);
+    HashBucket* m_buckets;
+    size_t m_num_buckets;
+    size_t m_mapped_bytes;
+    TablePages m_pages;
+    uint8_t m_generation;
+
+    void release();
+
+    /* maps the low 32 bits of the key onto [0, m_num_buckets) with
+     * a multiply instead of a modulo, any table size can be used */
+    HashBucket& bucket(uint64_t key) const {
+        return m_buckets[((key & 0xFFFFFFFF) * m_num_buckets) >> 32];
     }
-
-    void clear()
+public:
+    static constexpr size_t MIN_SIZE_MB = 1;
+    static constexpr size_t MAX_SIZE_MB = 1 << 17; // keeps bucket indices on 32 bits
+
+    TranspositionTable() :
+        m_buckets{ nullptr },
+        m_num_buckets{ 0 },
+        m_mapped_bytes{ 0 },
+        m_pages{ TablePages::SMALL },
+        m_generation{ 0 }
     {
-        m_entries.clear();
     }
-
-    inline E& get(uint64_t bkey) {
-
-        //uint64_t mask = (1 << 27) - 1;
-        //uint32_t key = (uint32_t)(bkey & mask);
-        uint64_t key = bkey;
-
-        auto it = m_entries.find(key);
-        if (it == m_entries.end()) {
-            auto res = m_entries.emplace(key, E{});
-            return res.first->second;
-        }
-        return it->second;
+    ~TranspositionTable() { release(); }
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    /* as many buckets as fit in `size_mb` megabytes, cleared,
+       throws and keeps the current table when they cannot be mapped */
+    void init(size_t size_mb);
+    /* zero the whole table, split among threads for big tables */
+    void clear();
+
+    size_t size_in_bytes() const { return m_num_buckets * sizeof(HashBucket); }
+    /* permille of entries written by the current search, sampled over the first buckets */
+    uint32_t hashfull() const;
+    /* size and kind of pages backing the table, for logging */
+    std::string memory_description() const;
+
+    /* write header and buckets to `path` */
+    void save(const std::string& path) const;
+    /* replace the table by the one saved in `path`, resized to its size */
+    void load(const std::string& path);
+    uint8_t generation() const { return m_generation; }
+    /* entries of previous searches become the first to be replaced */
+    void new_search() { m_generation = (m_generation + 1) & HashEntry::GENERATION_MASK; }
+
+    /* start loading the bucket of `key` into cache, probe it later */
+    void prefetch(uint64_t key) const {
+#if defined(_MSC_VER)
+        _mm_prefetch((const char*)&bucket(key), _MM_HINT_T0);
+#else
+        __builtin_prefetch(&bucket(key));
+#endif
     }
 
-
+    /**
+     * true and a copy of the entry of `key` with its slot if it is stored
+     * (now of the current generation), false and the slot a new entry for
+     * `key` should go to otherwise, an empty one or the least worth
+     * keeping, with a copy of what it holds
+     */
+    bool probe(uint64_t key, HashEntry& entry, HashSlot*& slot);
 };
 
 struct HashMethods {
     static uint64_t full_hash(const Board& b);
-    static void make_move(const Board& b, uint64_t& hash, const Move& move, uint8_t castle_diff);
+    static void make_move(const Board& b, uint64_t& hash, Move move, uint8_t castle_diff);
     static std::string to_string(uint64_t hash);
 
-    static void make_null_move(const Board& b, uint64_t& hash, const NullMove &m);
+    static void make_null_move(const Board& b, uint64_t& hash);
 
 };
 
@@ -2,6 +2,8 @@
 #define CHESS_TYPES_H
 
 #include <cstdint>
+#include <string>
+#include <exception>
 
 #ifdef CHESS_DEBUG
 #   define TIME_IT( timer ) do { SmartTime __x{(timer)}; 
@@ -144,7 +146,7 @@ public:
     inline bool operator==(const Pos& o) const {
         return row == o.row && column == o.column;
     }
-    uint8_t to_val() const { return row * 8 + column; }
+    constexpr uint8_t to_val() const { return row * 8 + column; }
 
     Pos& operator=(const Pos& o) {
         column = o.column;
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -92,6 +93,9 @@ void send_options()
     uci_send("option name UCI_Opponent type string\n");
     uci_send("option name UCI_EngineAbout type string default Tistou Chess by Thomas Mijieux. see https://github.com/tmijieux/chesspp\n");
     uci_send("option name UCI_AnalyseMode type check default false\n");
+    uci_send(fmt::format(
+        "option name Hash type spin default {} min {} max {}\n",
+        (int)DEFAULT_HASH_MB, TranspositionTable::MIN_SIZE_MB, TranspositionTable::MAX_SIZE_MB));
 }
 
 void send_uciok()
@@ -159,10 +163,10 @@ void parse_moves(MoveList &collected_moves, Board& b, const StringList& tokens,
         MoveList ml;
         add_move_from_position(b, src, ml, false);
         bool move_found = false;
-        for (auto& m : ml) {
-            if (m.dst == dst
-                && m.promote == promote
-                && (!promote || get_char_by_piece(m.promote_piece)==s_promote[0])) {
+        for (Move m : ml) {
+            if (m.dst() == dst
+                && m.is_promote() == promote
+                && (!promote || get_char_by_piece(m.promote_piece())==s_promote[0])) {
                 move_found = true;
                 collected_moves.push_back(m);
                 if (apply_to_board) {
@@ -308,6 +312,12 @@ void print_help()
         " Other commands:  \n\n"
 
         " - perft [n]\n"
+        " - bench [depth] : search all test positions at fixed depth\n"
+        " - allocaudit [depth] : fail if search allocates (CHESS_ALLOC_AUDIT builds)\n"
+        " - clearhash  : empty the transposition table\n"
+        " - hashstats  : transposition table use per ply in the last search\n"
+        " - savehash <file>  : write the transposition table to a file\n"
+        " - loadhash <file>  : read it back, Hash is resized to the file's\n"
         " - display \n"
         " - evaluate\n"
         " - init  : Load initial position\n"
@@ -375,6 +385,23 @@ int try_handle_one_command(
         }
         std::string varname = fmt::format("{}",fmt::join(var_name_tokens, " "));
         std::string val = fmt::format("{}",fmt::join(var_value_tokens, " "));
+        if (varname == "Hash") {
+            if (engine.is_running()) {
+                uci_send_info_string("cannot resize hash while searching");
+                return 0;
+            }
+            size_t i = 2 + var_name_tokens.size(); // at "value"
+            try {
+                engine.set_hash_size(read_integer<size_t>(tokens, i));
+            }
+            catch (chess_exception& e) {
+                uci_send_info_string("{}", e.what());
+            }
+            catch (std::logic_error&) { // from stoull: not a number or out of range
+                uci_send_info_string("invalid Hash value '{}'", val);
+            }
+            val = fmt::format("{}", engine.m_hash.size_in_bytes() >> 20);
+        }
         uci_send_info_string(fmt::format("option '{}' set to '{}'", varname, val));
     }
     else if (cmd == "ucinewgame")
@@ -426,6 +453,24 @@ int try_handle_one_command(
             engine.do_perft(b, num);
         }
     }
+    else if (cmd == "bench")
+    {
+        uint32_t depth = 6;
+        if (tokens.size() >= 2) {
+            size_t i = 0;
+            depth = read_integer<uint32_t>(tokens, i);
+        }
+        engine.do_bench(depth);
+    }
+    else if (cmd == "allocaudit")
+    {
+        uint32_t depth = 6;
+        if (tokens.size() >= 2) {
+            size_t i = 0;
+            depth = read_integer<uint32_t>(tokens, i);
+        }
+        engine.do_alloc_audit(depth);
+    }
     else if (cmd == "ui")
     {
         BoardRenderer r;
@@ -439,6 +484,29 @@ int try_handle_one_command(
     {
         engine.clear_hash();
     }
+    else if (cmd == "hashstats")
+    {
+        engine.display_hash_stats();
+    }
+    else if ((cmd == "savehash" || cmd == "loadhash") && tokens.size() >= 2)
+    {
+        if (engine.is_running()) {
+            uci_send_info_string("cannot {} while searching", cmd);
+            return 0;
+        }
+        try {
+            if (cmd == "savehash") {
+                engine.m_hash.save(tokens[1]);
+            }
+            else {
+                engine.load_hash(tokens[1]);
+            }
+            uci_send_info_string("{} {}: {}", cmd, tokens[1], engine.m_hash.memory_description());
+        }
+        catch (chess_exception& e) {
+            uci_send_info_string("{}", e.what());
+        }
+    }
     else if (cmd == "help" || cmd == "h" || cmd == "commands")
     {
         print_help();
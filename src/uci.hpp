@@ -1,6 +1,7 @@
 #ifndef CHESS_UCI_H
 #define CHESS_UCI_H
 
+#include <cstdio>
 #include <fmt/format.h>
 #include "./move.hpp"
 
@@ -35,7 +36,9 @@ struct GoParams {
 template<typename T, typename ...K>
 inline void uci_send(T&& t, K&&... k)
 {
-    std::cout << fmt::format(std::forward<T>(t), std::forward<K>(k)...) << std::flush;
+    // formats into a stack buffer, no temporary string
+    fmt::print(stdout, std::forward<T>(t), std::forward<K>(k)...);
+    std::fflush(stdout);
 }
 
 void uci_main_loop();